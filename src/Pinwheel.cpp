@@ -1,242 +1,36 @@
-#include "plugin.hpp"
-
-struct Pinwheel : Module {
-	enum ParamId {
-		NUMBLADES_PARAM,
-		SPEED_PARAM,
-		MASS_PARAM,
-		BLADEANGLEMOD_PARAM,
-        RANGE_PARAM,
-        GATE_TRIG_PARAM,   
-        BIPOLAR_UNIPOLAR_PARAM,
-		PARAMS_LEN
-	};
-	enum InputId {
-		SPEEDCVIN_INPUT,
-		NUMBLADESCVIN_INPUT,
-		MASSCVIN_INPUT,
-		BLADEANGLEMODCVIN_INPUT,
-		INPUTS_LEN
-	};
-	enum OutputId {
-		GATE1OUT_OUTPUT,
-		GATE2OUT_OUTPUT,
-		GATE3OUT_OUTPUT,
-		GATE4OUT_OUTPUT,
-		GATE5OUT_OUTPUT,
-		GATE6OUT_OUTPUT,
-		GATE7OUT_OUTPUT,
-		GATE8OUT_OUTPUT,
-		CV1OUT_OUTPUT,
-		CV2OUT_OUTPUT,
-		CV3OUT_OUTPUT,
-		CV4OUT_OUTPUT,
-		CV5OUT_OUTPUT,
-		CV6OUT_OUTPUT,
-		CV7OUT_OUTPUT,
-		CV8OUT_OUTPUT,
-        DIRECTIONL_OUTPUT,
-		DIRECTIONR_OUTPUT,
-		OUTPUTS_LEN
-	};
-	enum LightId {
-		GATE1LED_LIGHT,
-		GATE2LED_LIGHT,
-		GATE3LED_LIGHT,
-		GATE4LED_LIGHT,
-		GATE6LED_LIGHT,
-		GATE5LED_LIGHT,
-		GATE7LED_LIGHT,
-		GATE8LED_LIGHT,
-		CV1GREENLED_LIGHT,
-		CV1REDLED_LIGHT,
-		CV2GREENLED_LIGHT,
-		CV2REDLED_LIGHT,
-		CV3GREENLED_LIGHT,
-		CV3REDLED_LIGHT,
-		CV4GREENLED_LIGHT,
-		CV4REDLED_LIGHT,
-		CV5GREENLED_LIGHT,
-		CV5REDLED_LIGHT,
-		CV6GREENLED_LIGHT,
-		CV6REDLED_LIGHT,
-		CV7GREENLED_LIGHT,
-		CV7REDLED_LIGHT,
-		CV8GREENLED_LIGHT,
-		CV8REDLED_LIGHT,
-		DIRECTIONLLED_LIGHT,
-        DIRECTIONRLED_LIGHT,
-		LIGHTS_LEN
-	};
-
-    float angle = 0.f;
-    float slewedSpeed = 0.f;
-    float slewedAngleMod = 0.f;
-    bool prevGateState[8] = {};
-    float triggerTimers[8] = {};
-
-
-    Pinwheel() {
-        config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
-        configParam(SPEED_PARAM, 0.f, 1.f, 0.5f, "Speed");
-        configParam(MASS_PARAM, 0.f, 1.f, 0.f, "Mass");
-        configSwitch(NUMBLADES_PARAM, 1.f, 8.f, 4.f, "Number of Blades", {"1", "2", "3", "4", "5", "6", "7", "8"});
-        configParam(BLADEANGLEMOD_PARAM, -1.f, 1.f, 0.f, "Blade Angle Mod");
-        configInput(SPEEDCVIN_INPUT, "Speed CV In");
-        configInput(MASSCVIN_INPUT, "Mass CV In");
-        configInput(NUMBLADESCVIN_INPUT, "Number of Blades CV In");
-        configInput(BLADEANGLEMODCVIN_INPUT, "Blade Angle Mod CV In");
-        configSwitch(RANGE_PARAM, 0.f, 1.f, 0.f, "Range", {"Slow", "Fast"});
-        configSwitch(GATE_TRIG_PARAM, 0.f, 1.f, 0.f, "Gate/Trig", {"Gate", "Trig"});
-        configSwitch(BIPOLAR_UNIPOLAR_PARAM, 0.f, 1.f, 0.f, "Bipolar/Unipolar", {"Bipolar", "Unipolar"});
-
-        configOutput(DIRECTIONL_OUTPUT, "Spinning Left");
-        configOutput(DIRECTIONR_OUTPUT, "Spinning Right");
-
-        for (int i = 0; i < 8; i++) {
-            configOutput(GATE1OUT_OUTPUT + i, "Gate Out");
-            configOutput(CV1OUT_OUTPUT + i, "CV Out");
-        }
-    }
+#include "Pinwheel.hpp"
+#include <osdialog.h>
 
-   void process(const ProcessArgs& args) override {
-    float speedKnobVoltage = rescale(params[SPEED_PARAM].getValue(), 0.f, 1.f, -5.f, 5.f);
-    float speedCVVoltage = inputs[SPEEDCVIN_INPUT].isConnected() ? clamp(inputs[SPEEDCVIN_INPUT].getVoltage(), -5.f, 5.f) : 0.f;
-    float combinedSpeedVoltage = clamp(speedKnobVoltage + speedCVVoltage, -5.f, 5.f);
-    float speedParam = rescale(combinedSpeedVoltage, -5.f, 5.f, 0.f, 1.f);
-
-    float rangeSwitch = params[RANGE_PARAM].getValue();
-    float speedMultiplier = (rangeSwitch < 0.5f) ? 0.1f : 1.0f;
-    float targetSpeed = (speedParam - 0.5f) * 2.f * speedMultiplier;
-
-    float massKnobVoltage = rescale(params[MASS_PARAM].getValue(), 0.f, 1.f, -5.f, 5.f);
-    float massCVVoltage = inputs[MASSCVIN_INPUT].isConnected() ? clamp(inputs[MASSCVIN_INPUT].getVoltage(), -5.f, 5.f) : 0.f;
-    float combinedMassVoltage = clamp(massKnobVoltage + massCVVoltage, -5.f, 5.f);
-    float combinedMass = rescale(combinedMassVoltage, -5.f, 5.f, 0.f, 1.f);
-
-    float maxSlewTime = 1.f;
-    float minSlewTime = 0.001f;
-    float slewTime = rescale(combinedMass, 0.f, 1.f, minSlewTime, maxSlewTime);
-    float slewAmount = clamp(args.sampleTime / slewTime, 0.f, 1.f);
-    slewedSpeed += (targetSpeed - slewedSpeed) * slewAmount;
-
-    float rotationRate = slewedSpeed * 8.f * M_PI;
-    angle += rotationRate * args.sampleTime;
-    if (angle >= 2.f * M_PI) angle -= 2.f * M_PI;
-    else if (angle < 0.f) angle += 2.f * M_PI;
-
-    float numBladesKnob = rescale(params[NUMBLADES_PARAM].getValue(), 1.f, 8.f, -5.f, 5.f);
-    float numBladesCV = inputs[NUMBLADESCVIN_INPUT].isConnected() ? clamp(inputs[NUMBLADESCVIN_INPUT].getVoltage(), -5.f, 5.f) : 0.f;
-    float combinedNumBladesVoltage = clamp(numBladesKnob + numBladesCV, -5.f, 5.f);
-    float combinedNumBlades = rescale(combinedNumBladesVoltage, -5.f, 5.f, 1.f, 8.f);
-    int numberOfBlades = clamp((int)std::round(combinedNumBlades), 1, 8);
-
-    float angleModKnob = params[BLADEANGLEMOD_PARAM].getValue();
-    float angleModCV = inputs[BLADEANGLEMODCVIN_INPUT].isConnected() ? clamp(inputs[BLADEANGLEMODCVIN_INPUT].getVoltage() / 5.f, -1.f, 1.f) : 0.f;
-    float targetAngleMod = clamp(angleModKnob + angleModCV, -1.f, 1.f);
-    slewedAngleMod += (targetAngleMod - slewedAngleMod) * slewAmount;
-    float totalAngleMod = slewedAngleMod;
-
-    float gateTrigSwitch = params[GATE_TRIG_PARAM].getValue();
-    bool unipolar = params[BIPOLAR_UNIPOLAR_PARAM].getValue() >= 0.5f;
-
-    for (int i = 0; i < 8; ++i) {
-        if (i < numberOfBlades) {
-            float baseSpacing = (2.f * M_PI / numberOfBlades);
-            float modulatedOffset = baseSpacing * i * (1.f + totalAngleMod);
-            float bladeAngle = angle + modulatedOffset;
-            if (bladeAngle >= 2.f * M_PI) bladeAngle -= 2.f * M_PI;
-
-            float shiftedAngle = bladeAngle - (M_PI / 2.f);
-            if (shiftedAngle < 0.f) shiftedAngle += 2.f * M_PI;
-
-            float CVout = 0.f;
-            if (shiftedAngle <= M_PI)
-                CVout = rescale(shiftedAngle, 0.f, M_PI, 5.f, -5.f);
-            else
-                CVout = rescale(shiftedAngle, M_PI, 2.f * M_PI, -5.f, 5.f);
+struct PinwheelDisplay : Widget {
+    Pinwheel* module;
 
-            if (unipolar) {
-                CVout = (CVout + 5.f) * 0.5f;
-            }
+    // Blade artwork rendered once per blade count, blade offsets and zoom, then drawn as a rotated texture.
+    // FramebufferWidget refuses rotated transforms, so the display owns its framebuffer and renders it
+    // the same way FramebufferWidget::render() does.
+    NVGLUframebuffer* bladeFb = NULL;
+    int cachedBlades = 0;
+    float cachedOffsets[8] = {};
+    float cachedScale = 0.f;
 
-            outputs[CV1OUT_OUTPUT + i].setVoltage(CVout);
-
-            const float side = 25.f * 0.7f;
-            const float flatHeight = side * 0.866f;
-            float tipRadius = side + flatHeight;
-            float tipX = tipRadius * cos(bladeAngle);
-            float tipY = -tipRadius * sin(bladeAngle);
-            const float stemWidth = 5.f;
-            bool gateActive = (fabs(tipX) <= (stemWidth / 2.f)) && (tipY >= 0.f);
-
-            if (gateTrigSwitch < 0.5f) {
-                outputs[GATE1OUT_OUTPUT + i].setVoltage(gateActive ? 5.f : 0.f);
-                lights[GATE1LED_LIGHT + i].setBrightnessSmooth(gateActive ? 1.f : 0.f, args.sampleTime);
-            } else {
-                bool gateRisingEdge = gateActive && !prevGateState[i];
-                if (gateRisingEdge) {
-                    triggerTimers[i] = 0.001f;
-                }
-                prevGateState[i] = gateActive;
-
-                if (triggerTimers[i] > 0.f) {
-                    triggerTimers[i] -= args.sampleTime;
-                    outputs[GATE1OUT_OUTPUT + i].setVoltage(5.f);
-                    lights[GATE1LED_LIGHT + i].setBrightnessSmooth(1.f, args.sampleTime);
-                } else {
-                    outputs[GATE1OUT_OUTPUT + i].setVoltage(0.f);
-                    lights[GATE1LED_LIGHT + i].setBrightnessSmooth(0.f, args.sampleTime);
-                }
-            }
+    // Rotation of the last frame, held until the blade tips would move by redrawThreshold pixels
+    float drawnAngle = 0.f;
+    static constexpr float redrawThreshold = 0.5f;
 
-            if (!unipolar) {
-                if (CVout >= 0.f) {
-                    lights[CV1GREENLED_LIGHT + i * 2].setBrightnessSmooth(clamp(CVout / 10.f, 0.f, 1.f), args.sampleTime);
-                    lights[CV1REDLED_LIGHT + i * 2].setBrightnessSmooth(0.f, args.sampleTime);
-                } else {
-                    lights[CV1GREENLED_LIGHT + i * 2].setBrightnessSmooth(0.f, args.sampleTime);
-                    lights[CV1REDLED_LIGHT + i * 2].setBrightnessSmooth(clamp(-CVout / 10.f, 0.f, 1.f), args.sampleTime);
-                }
-            } else {
-                lights[CV1GREENLED_LIGHT + i * 2].setBrightnessSmooth(clamp(CVout / 5.f, 0.f, 1.f), args.sampleTime);
-                lights[CV1REDLED_LIGHT + i * 2].setBrightnessSmooth(0.f, args.sampleTime);
-            }
-        } else {
-            outputs[GATE1OUT_OUTPUT + i].setVoltage(0.f);
-            outputs[CV1OUT_OUTPUT + i].setVoltage(0.f);
-            lights[GATE1LED_LIGHT + i].setBrightnessSmooth(0.f, args.sampleTime);
-            lights[CV1GREENLED_LIGHT + i * 2].setBrightnessSmooth(0.f, args.sampleTime);
-            lights[CV1REDLED_LIGHT + i * 2].setBrightnessSmooth(0.f, args.sampleTime);
-            prevGateState[i] = false;
-            triggerTimers[i] = 0.f;
-        }
+    PinwheelDisplay(Pinwheel* module) {
+        this->module = module;
     }
 
-    if (speedParam > 0.5f) {
-        outputs[DIRECTIONL_OUTPUT].setVoltage(0.f);
-        outputs[DIRECTIONR_OUTPUT].setVoltage(5.f);
-        lights[DIRECTIONLLED_LIGHT].setBrightnessSmooth(0.f, args.sampleTime);
-        lights[DIRECTIONRLED_LIGHT].setBrightnessSmooth(1.f, args.sampleTime);
-    } else if (speedParam < 0.5f) {
-        outputs[DIRECTIONL_OUTPUT].setVoltage(5.f);
-        outputs[DIRECTIONR_OUTPUT].setVoltage(0.f);
-        lights[DIRECTIONLLED_LIGHT].setBrightnessSmooth(1.f, args.sampleTime);
-        lights[DIRECTIONRLED_LIGHT].setBrightnessSmooth(0.f, args.sampleTime);
-    } else {
-        outputs[DIRECTIONL_OUTPUT].setVoltage(0.f);
-        outputs[DIRECTIONR_OUTPUT].setVoltage(0.f);
-        lights[DIRECTIONLLED_LIGHT].setBrightnessSmooth(0.f, args.sampleTime);
-        lights[DIRECTIONRLED_LIGHT].setBrightnessSmooth(0.f, args.sampleTime);
+    ~PinwheelDisplay() {
+        if (bladeFb)
+            nvgluDeleteFramebuffer(bladeFb);
     }
-}
-};
-
-struct PinwheelDisplay : Widget {
-    Pinwheel* module;
 
-    PinwheelDisplay(Pinwheel* module) {
-        this->module = module;
+    void onContextDestroy(const ContextDestroyEvent& e) override {
+        if (bladeFb) {
+            nvgluDeleteFramebuffer(bladeFb);
+            bladeFb = NULL;
+        }
+        Widget::onContextDestroy(e);
     }
 
     NVGcolor hsvToRgb(float h, float s, float v) {
@@ -305,53 +99,396 @@ struct PinwheelDisplay : Widget {
         nvgRestore(args.vg);
     }
 
+    // Draws every blade and the hub around the origin, unrotated
+    void drawBladeArt(const DrawArgs& args, const PinwheelSnapshot& snapshot, float side, float flatHeight) {
+        for (int i = 0; i < snapshot.numberOfBlades; ++i) {
+            float hue = (float)i / snapshot.numberOfBlades;
+            NVGcolor bladeColor = hsvToRgb(hue, 1.f, 1.f);
+
+            nvgSave(args.vg);
+            nvgRotate(args.vg, snapshot.bladeOffsets[i]);
+            drawBlade(args, bladeColor, side, flatHeight);
+            nvgRestore(args.vg);
+        }
+
+        nvgBeginPath(args.vg);
+        nvgCircle(args.vg, 0.f, 0.f, 4.f);
+        nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 255));
+        nvgFill(args.vg);
+    }
+
+    bool renderBladeArt(const DrawArgs& args, const PinwheelSnapshot& snapshot, float side, float flatHeight, float scale) {
+        int fbWidth = (int) std::ceil(box.size.x * scale);
+        int fbHeight = (int) std::ceil(box.size.y * scale);
+
+        if (bladeFb && scale != cachedScale) {
+            nvgluDeleteFramebuffer(bladeFb);
+            bladeFb = NULL;
+        }
+        if (!bladeFb)
+            bladeFb = nvgluCreateFramebuffer(args.vg, fbWidth, fbHeight, 0);
+        if (!bladeFb)
+            return false;
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        nvgluBindFramebuffer(bladeFb);
+        glViewport(0, 0, fbWidth, fbHeight);
+        glClearColor(0.f, 0.f, 0.f, 0.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        NVGcontext* vg = APP->window->fbVg;
+        nvgBeginFrame(vg, fbWidth, fbHeight, 1.f);
+        nvgScale(vg, scale, scale);
+        nvgTranslate(vg, box.size.x / 2.f, box.size.y / 2.f);
+        DrawArgs fbArgs = args;
+        fbArgs.vg = vg;
+        fbArgs.fb = bladeFb;
+        drawBladeArt(fbArgs, snapshot, side, flatHeight);
+        nvgEndFrame(vg);
+        nvgReset(vg);
+
+        nvgluBindFramebuffer(NULL);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        cachedBlades = snapshot.numberOfBlades;
+        std::copy(snapshot.bladeOffsets, snapshot.bladeOffsets + 8, cachedOffsets);
+        cachedScale = scale;
+        return true;
+    }
+
+    bool drawCachedBlades(const DrawArgs& args, const PinwheelSnapshot& snapshot, float side, float flatHeight) {
+        // Convert the pixel threshold to radians at the blade tips for the current zoom
+        float xform[6];
+        nvgCurrentTransform(args.vg, xform);
+        float scale = std::hypot(xform[0], xform[1]);
+        float tipRadius = side + 2.f * flatHeight;
+        float threshold = redrawThreshold / (tipRadius * scale);
+
+        bool stale = !bladeFb || snapshot.numberOfBlades != cachedBlades || scale != cachedScale;
+        for (int i = 0; i < snapshot.numberOfBlades; ++i)
+            stale = stale || std::fabs(snapshot.bladeOffsets[i] - cachedOffsets[i]) > threshold;
+        if (stale && !renderBladeArt(args, snapshot, side, flatHeight, scale))
+            return false;
+
+        if (std::fabs(snapshot.angle - drawnAngle) > threshold)
+            drawnAngle = snapshot.angle;
+
+        Vec center = box.size.div(2);
+        nvgSave(args.vg);
+        nvgRotate(args.vg, drawnAngle);
+        NVGpaint paint = nvgImagePattern(args.vg, -center.x, -center.y, box.size.x, box.size.y, 0.f, bladeFb->image, 1.f);
+        nvgBeginPath(args.vg);
+        nvgRect(args.vg, -center.x, -center.y, box.size.x, box.size.y);
+        nvgFillPaint(args.vg, paint);
+        nvgFill(args.vg);
+        nvgRestore(args.vg);
+        return true;
+    }
+
+    // Scope view: a row per blade, newest column on the right. Each CV is one filled path out along the column
+    // maxima and back along the minima, over one path of bars where its gate was high.
+    void drawScope(const DrawArgs& args) {
+        const PinwheelSnapshot& snapshot = module->displaySnapshot.read();
+        const PinwheelScope& scope = module->scope;
+        uint32_t published = scope.published.load(std::memory_order_acquire);
+        int n = (int) std::min<uint32_t>(published, PinwheelScope::columns);
+        uint32_t first = published - n;
+
+        float columnWidth = box.size.x / PinwheelScope::columns;
+        float left = box.size.x - n * columnWidth;
+        float rowHeight = box.size.y / snapshot.numberOfBlades;
+        // Bipolar CVs run from -5 V to 5 V, unipolar ones from 0 V to 5 V
+        float bottom = snapshot.unipolar ? 0.f : -5.f;
+        float scale = (rowHeight - 2.f) / (5.f - bottom);
+
+        nvgBeginPath(args.vg);
+        nvgRect(args.vg, 0.f, 0.f, box.size.x, box.size.y);
+        nvgFillColor(args.vg, nvgRGBA(20, 20, 20, 255));
+        nvgFill(args.vg);
+
+        for (int i = 0; i < snapshot.numberOfBlades; i++) {
+            NVGcolor color = hsvToRgb((float) i / snapshot.numberOfBlades, 1.f, 1.f);
+            float top = i * rowHeight;
+            float base = top + rowHeight - 1.f;
+
+            // One bar per run of columns with the gate high
+            nvgBeginPath(args.vg);
+            for (int k = 0; k < n;) {
+                if (!(scope.ring[(first + k) % PinwheelScope::ringColumns].gates & (1 << i))) {
+                    k++;
+                    continue;
+                }
+                int start = k;
+                while (k < n && (scope.ring[(first + k) % PinwheelScope::ringColumns].gates & (1 << i)))
+                    k++;
+                nvgRect(args.vg, left + start * columnWidth, top, (k - start) * columnWidth, rowHeight);
+            }
+            nvgFillColor(args.vg, darkenColor(color, 0.3f));
+            nvgFill(args.vg);
+
+            if (n == 0)
+                continue;
+
+            // Half a pixel either side keeps a steady CV visible as a line
+            nvgBeginPath(args.vg);
+            for (int k = 0; k < n; k++) {
+                const PinwheelScope::Column& column = scope.ring[(first + k) % PinwheelScope::ringColumns];
+                float x = left + (k + 0.5f) * columnWidth;
+                float y = base - (clamp(column.max[i], bottom, 5.f) - bottom) * scale - 0.5f;
+                if (k == 0)
+                    nvgMoveTo(args.vg, x, y);
+                else
+                    nvgLineTo(args.vg, x, y);
+            }
+            for (int k = n - 1; k >= 0; k--) {
+                const PinwheelScope::Column& column = scope.ring[(first + k) % PinwheelScope::ringColumns];
+                float x = left + (k + 0.5f) * columnWidth;
+                nvgLineTo(args.vg, x, base - (clamp(column.min[i], bottom, 5.f) - bottom) * scale + 0.5f);
+            }
+            nvgClosePath(args.vg);
+            nvgFillColor(args.vg, color);
+            nvgFill(args.vg);
+        }
+    }
+
     void draw(const DrawArgs& args) override {
     if (!module) return;
 
+    if (module->scopeView) {
+        drawScope(args);
+        return;
+    }
+
     Vec center = box.size.div(2);
     nvgSave(args.vg);
     nvgTranslate(args.vg, center.x, center.y);
 
-    nvgBeginPath(args.vg);
-    nvgRect(args.vg, -2.5f, 0.f, 5.f, 100.f);
-    nvgFillColor(args.vg, nvgRGBA(60, 60, 60, 255));
-    nvgFill(args.vg);
-
-    nvgRotate(args.vg, module->angle);
-
     float side = 25.f * 0.7f;
     float flatHeight = side * 0.866f;
 
-    float numBladesKnob = rescale(module->params[Pinwheel::NUMBLADES_PARAM].getValue(), 1.f, 8.f, -5.f, 5.f);
-    float numBladesCV = module->inputs[Pinwheel::NUMBLADESCVIN_INPUT].isConnected() ? clamp(module->inputs[Pinwheel::NUMBLADESCVIN_INPUT].getVoltage(), -5.f, 5.f) : 0.f;
-    float combinedNumBladesVoltage = clamp(numBladesKnob + numBladesCV, -5.f, 5.f);
-    float combinedNumBlades = rescale(combinedNumBladesVoltage, -5.f, 5.f, 1.f, 8.f);
-    int numberOfBlades = clamp((int)std::round(combinedNumBlades), 1, 8);
-
-    float totalAngleMod = module->slewedAngleMod;
-
-    float baseSpacing = (2.f * M_PI / numberOfBlades);
+    // Only the published snapshot is read here, never the engine's own state
+    const PinwheelSnapshot& snapshot = module->displaySnapshot.read();
 
-    for (int i = 0; i < numberOfBlades; ++i) {
-        float hue = (float)i / numberOfBlades;
-        NVGcolor bladeColor = hsvToRgb(hue, 1.f, 1.f);
+    // One stem per detector, as wide as its window at the blade tips; the first is the original stem straight down.
+    // When the gates follow the detectors, a stem lights up while its gate is open.
+    float tipRadius = side + flatHeight;
+    for (int d = 0; d < module->numDetectors; d++) {
+        const PinwheelDetector& detector = module->detectors[d];
+        float stemWidth = 2.f * tipRadius * std::sin(detector.halfWidth);
+        bool open = snapshot.detectorGates && (snapshot.gates & (1 << d));
+        nvgSave(args.vg);
+        nvgRotate(args.vg, detector.position - 1.5f * M_PI);
+        nvgBeginPath(args.vg);
+        nvgRect(args.vg, -stemWidth / 2.f, 0.f, stemWidth, 100.f);
+        nvgFillColor(args.vg, open ? nvgRGBA(140, 140, 140, 255) : nvgRGBA(60, 60, 60, 255));
+        nvgFill(args.vg);
+        nvgRestore(args.vg);
+    }
 
+    // Inside another framebuffer (module browser, screenshots) the vectors are drawn directly
+    float angle = drawnAngle;
+    if (args.fb || !drawCachedBlades(args, snapshot, side, flatHeight)) {
+        angle = snapshot.angle;
         nvgSave(args.vg);
-        nvgRotate(args.vg, baseSpacing * i * (1.f + totalAngleMod));  // <--- here
-        drawBlade(args, bladeColor, side, flatHeight);
+        nvgRotate(args.vg, angle);
+        drawBladeArt(args, snapshot, side, flatHeight);
         nvgRestore(args.vg);
     }
 
-    nvgBeginPath(args.vg);
-    nvgCircle(args.vg, 0.f, 0.f, 4.f);
-    nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 255));
-    nvgFill(args.vg);
+    // When the gates follow the blades, a dot on the tip of each blade whose gate is high
+    if (!snapshot.detectorGates) {
+        for (int i = 0; i < snapshot.numberOfBlades; ++i) {
+            if (!(snapshot.gates & (1 << i)))
+                continue;
+            nvgSave(args.vg);
+            nvgRotate(args.vg, angle + snapshot.bladeOffsets[i]);
+            nvgBeginPath(args.vg);
+            nvgCircle(args.vg, -(side + 2.f * flatHeight), 0.f, 2.5f);
+            nvgFillColor(args.vg, nvgRGBA(255, 255, 255, 255));
+            nvgFill(args.vg);
+            nvgRestore(args.vg);
+        }
+    }
 
     nvgRestore(args.vg);
 }
 };
 
 
+/** Context menu editor for the user shape. Click or drag to draw the curve; each column sets one point. */
+struct UserShapeEditor : OpaqueWidget {
+    Pinwheel* module;
+    Vec dragPos;
+
+    UserShapeEditor(Pinwheel* module) {
+        this->module = module;
+        box.size = Vec(192.f, 96.f);
+    }
+
+    void setPoint(Vec pos) {
+        int k = clamp((int) (pos.x / box.size.x * Pinwheel::userShapePoints), 0, Pinwheel::userShapePoints - 1);
+        module->userShape[k] = clamp(1.f - 2.f * pos.y / box.size.y, -1.f, 1.f);
+        module->userShapeVersion++;
+    }
+
+    void onButton(const ButtonEvent& e) override {
+        if (e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT) {
+            e.consume(this);
+            dragPos = e.pos;
+            setPoint(dragPos);
+        }
+    }
+
+    void onDragMove(const DragMoveEvent& e) override {
+        dragPos = dragPos.plus(e.mouseDelta.div(getAbsoluteZoom()));
+        setPoint(dragPos);
+    }
+
+    void draw(const DrawArgs& args) override {
+        nvgBeginPath(args.vg);
+        nvgRect(args.vg, 0.f, 0.f, box.size.x, box.size.y);
+        nvgFillColor(args.vg, nvgRGB(30, 30, 30));
+        nvgFill(args.vg);
+
+        nvgBeginPath(args.vg);
+        nvgMoveTo(args.vg, 0.f, box.size.y / 2.f);
+        nvgLineTo(args.vg, box.size.x, box.size.y / 2.f);
+        nvgStrokeColor(args.vg, nvgRGB(80, 80, 80));
+        nvgStrokeWidth(args.vg, 1.f);
+        nvgStroke(args.vg);
+
+        // One turn from the blade pointing up, closed back onto the first point
+        float column = box.size.x / Pinwheel::userShapePoints;
+        nvgBeginPath(args.vg);
+        for (int k = 0; k <= Pinwheel::userShapePoints; k++) {
+            float x = (k + 0.5f) * column;
+            float y = (1.f - module->userShape[k % Pinwheel::userShapePoints]) * box.size.y / 2.f;
+            if (k == 0)
+                nvgMoveTo(args.vg, x, y);
+            else
+                nvgLineTo(args.vg, x, y);
+        }
+        nvgStrokeColor(args.vg, nvgRGB(255, 200, 0));
+        nvgStrokeWidth(args.vg, 1.5f);
+        nvgStroke(args.vg);
+    }
+};
+
+
+/** Position or width of one detector in degrees, for the sliders in the context menu. Positions count
+clockwise from straight down, the way the blades travel when spinning right. */
+struct DetectorQuantity : Quantity {
+    Pinwheel* module;
+    int index;
+    bool width;
+
+    DetectorQuantity(Pinwheel* module, int index, bool width) {
+        this->module = module;
+        this->index = index;
+        this->width = width;
+    }
+
+    void setValue(float value) override {
+        PinwheelDetector& detector = module->detectors[index];
+        value = clamp(value, getMinValue(), getMaxValue());
+        if (width)
+            detector.halfWidth = value * float(M_PI / 360.f);
+        else
+            detector.position = 1.5f * M_PI + value * float(M_PI / 180.f);
+        module->detectorVersion++;
+    }
+
+    float getValue() override {
+        const PinwheelDetector& detector = module->detectors[index];
+        if (width)
+            return detector.halfWidth * float(360.f / M_PI);
+        return eucMod((detector.position - 1.5f * M_PI) * float(180.f / M_PI), 360.f);
+    }
+
+    float getMinValue() override {
+        return width ? 1.f : 0.f;
+    }
+
+    float getMaxValue() override {
+        return width ? 180.f : 360.f;
+    }
+
+    float getDefaultValue() override {
+        return width ? module->gateHalfWidth * float(360.f / M_PI) : index * 360.f / PinwheelDetectorIndex::maxDetectors;
+    }
+
+    std::string getLabel() override {
+        return string::f("Detector %d %s", index + 1, width ? "width" : "position");
+    }
+
+    std::string getUnit() override {
+        return "°";
+    }
+
+    int getDisplayPrecision() override {
+        return 3;
+    }
+};
+
+struct DetectorSlider : ui::Slider {
+    DetectorSlider(Pinwheel* module, int index, bool width) {
+        quantity = new DetectorQuantity(module, index, width);
+        box.size.x = 200.f;
+    }
+
+    ~DetectorSlider() {
+        delete quantity;
+    }
+};
+
+
+/** Context menu line showing part of the latest profile, refreshed while the menu is open. */
+struct ProfileLabel : MenuLabel {
+    Pinwheel* module;
+    std::function<std::string(const PinwheelProfile&)> format;
+
+    ProfileLabel(Pinwheel* module, std::function<std::string(const PinwheelProfile&)> format) {
+        this->module = module;
+        this->format = format;
+    }
+
+    void step() override {
+        text = format(module->profiler.reports.read());
+        MenuLabel::step();
+    }
+};
+
+
+/** Context menu line showing how the recording is going, refreshed while the menu is open. */
+struct RecorderLabel : MenuLabel {
+    Pinwheel* module;
+
+    RecorderLabel(Pinwheel* module) {
+        this->module = module;
+    }
+
+    void step() override {
+        const PinwheelRecorder& recorder = module->recorder;
+        int64_t frames = recorder.written.load(std::memory_order_relaxed);
+        int seconds = (int) (frames / recorder.sampleRate);
+        text = string::f("%s %d:%02d, %lld frames dropped%s", recorder.requested ? "Recording" : "Writing out",
+            seconds / 60, seconds % 60, (long long) recorder.dropped.load(std::memory_order_relaxed),
+            recorder.failed ? ", write failed" : "");
+        MenuLabel::step();
+    }
+};
+
+static void startRecording(Pinwheel* module, PinwheelRecorder::Format format) {
+    const char* filename = (format == PinwheelRecorder::WAV_FORMAT) ? "pinwheel.wav" : "pinwheel.f32";
+    char* path = osdialog_file(OSDIALOG_SAVE, NULL, filename, NULL);
+    if (!path)
+        return;
+    if (!module->recorder.start(path, format, 1.f / module->sampleTime))
+        WARN("Could not record Pinwheel to %s", path);
+    std::free(path);
+}
+
 
 struct PinwheelWidget : ModuleWidget {
 	PinwheelWidget(Pinwheel* module) {
@@ -424,7 +561,7 @@ struct PinwheelWidget : ModuleWidget {
         addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(17.242, 80.0)), module, Pinwheel::BLADEANGLEMOD_PARAM));
         addInput(createInputCentered<PJ301MPort>(mm2px(Vec(27.039, 80.0)), module, Pinwheel::BLADEANGLEMODCVIN_INPUT)); 
 
-        addParam(createParam<CKSS>(mm2px(Vec(5, 90)), module, Pinwheel::RANGE_PARAM));
+        addParam(createParam<CKSSThree>(mm2px(Vec(5, 90)), module, Pinwheel::RANGE_PARAM));
 
         addParam(createParamCentered<CKSSHorizontal>(mm2px(Vec(55, 89)), module, Pinwheel::GATE_TRIG_PARAM));
 
@@ -435,6 +572,144 @@ struct PinwheelWidget : ModuleWidget {
 
         addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(7, 60)), module, Pinwheel::DIRECTIONL_OUTPUT));
         addChild(createLightCentered<MediumLight<RedLight>>(mm2px(Vec(7, 50)), module, Pinwheel::DIRECTIONLLED_LIGHT));
+
+        addChild(createLightCentered<MediumLight<GreenLight>>(mm2px(Vec(89, 50)), module, Pinwheel::SYNCLED_LIGHT));
+        addParam(createParamCentered<RoundSmallBlackKnob>(mm2px(Vec(89, 62)), module, Pinwheel::RATIO_PARAM));
+        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(89, 76)), module, Pinwheel::CLOCK_INPUT));
+        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(89, 38)), module, Pinwheel::VOCT_INPUT));
+
+        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(39, 80)), module, Pinwheel::WIND_INPUT));
+        addParam(createParamCentered<RoundSmallBlackKnob>(mm2px(Vec(51, 80)), module, Pinwheel::FRICTION_PARAM));
+        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(63, 80)), module, Pinwheel::GUST_INPUT));
+
+        addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(7, 26)), module, Pinwheel::ALLGATES_OUTPUT));
+        addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(7, 38)), module, Pinwheel::ALLCV_OUTPUT));
+	}
+
+	void appendContextMenu(Menu* menu) override {
+		Pinwheel* module = getModule<Pinwheel>();
+
+		menu->addChild(new MenuSeparator);
+
+		static const std::vector<int> controlRateDivisions = {1, 4, 8, 16, 32, 64};
+		menu->addChild(createIndexSubmenuItem("Control rate",
+			{"Every sample", "Every 4 samples", "Every 8 samples", "Every 16 samples", "Every 32 samples", "Every 64 samples"},
+			[=]() {
+				auto it = std::find(controlRateDivisions.begin(), controlRateDivisions.end(), module->controlRateDivision);
+				return (size_t) (it - controlRateDivisions.begin());
+			},
+			[=](size_t index) {
+				module->controlRateDivision = controlRateDivisions[index];
+			}
+		));
+
+		menu->addChild(createBoolPtrMenuItem("Event-driven gate detection", "", &module->eventDrivenGates));
+
+		menu->addChild(createBoolPtrMenuItem("Physical rotor", "", &module->physics));
+
+		menu->addChild(createIndexSubmenuItem("Display", {"Rotor", "Scope history"},
+			[=]() {
+				return (size_t) module->scopeView;
+			},
+			[=](size_t index) {
+				module->scopeView = index == 1;
+			}
+		));
+
+		menu->addChild(new MenuSeparator);
+
+		static const std::vector<std::string> shapeLabels = {"Triangle", "Sine", "Saw", "Ramp", "Exponential", "Stepped", "User"};
+		menu->addChild(createIndexPtrSubmenuItem("CV shape", shapeLabels, &module->shape));
+
+		menu->addChild(createSubmenuItem("Blade shapes", "", [=](Menu* menu) {
+			std::vector<std::string> labels = {"Same as CV shape"};
+			labels.insert(labels.end(), shapeLabels.begin(), shapeLabels.end());
+			for (int i = 0; i < 8; i++) {
+				menu->addChild(createIndexSubmenuItem(string::f("Blade %d", i + 1), labels,
+					[=]() {return (size_t) (module->bladeShapes[i] + 1);},
+					[=](size_t index) {module->bladeShapes[i] = (int) index - 1;}
+				));
+			}
+		}));
+
+		menu->addChild(createSubmenuItem("User shape", "", [=](Menu* menu) {
+			menu->addChild(createMenuLabel("One turn, starting with the blade pointing up"));
+			menu->addChild(new UserShapeEditor(module));
+		}));
+
+		menu->addChild(new MenuSeparator);
+
+		menu->addChild(createIndexSubmenuItem("Detectors", {"1", "2", "3", "4", "5", "6", "7", "8"},
+			[=]() {return (size_t) (module->numDetectors - 1);},
+			[=](size_t index) {
+				module->numDetectors = (int) index + 1;
+				module->detectorVersion++;
+			}
+		));
+
+		menu->addChild(createIndexSubmenuItem("Gate outputs", {"Per blade, in any detector", "Per detector, any blade"},
+			[=]() {return (size_t) module->detectorOutputs;},
+			[=](size_t index) {module->detectorOutputs = index;}
+		));
+
+		menu->addChild(createSubmenuItem("Detector positions", "", [=](Menu* menu) {
+			for (int d = 0; d < module->numDetectors; d++) {
+				menu->addChild(new DetectorSlider(module, d, false));
+				menu->addChild(new DetectorSlider(module, d, true));
+			}
+		}));
+
+		menu->addChild(new MenuSeparator);
+
+		menu->addChild(createBoolPtrMenuItem("Profile process()", "", &module->profiling));
+
+		menu->addChild(createSubmenuItem("Profile", "", [=](Menu* menu) {
+			std::string unit = PinwheelProfile::unit();
+			menu->addChild(new ProfileLabel(module, [=](const PinwheelProfile& p) {
+				return string::f("Last block: p50 %llu, p99 %llu, max %llu %s", (unsigned long long) p.blockP50,
+					(unsigned long long) p.blockP99, (unsigned long long) p.blockMax, unit.c_str());
+			}));
+			menu->addChild(new ProfileLabel(module, [=](const PinwheelProfile& p) {
+				return string::f("Overall: p50 %llu, p99 %llu, max %llu %s", (unsigned long long) p.p50,
+					(unsigned long long) p.p99, (unsigned long long) p.max, unit.c_str());
+			}));
+			menu->addChild(new ProfileLabel(module, [=](const PinwheelProfile& p) {
+				float seconds = p.samples * module->sampleTime;
+				return string::f("%.1f s: %lld gate edges, slews moving %.0f%% of the time", seconds, (long long) p.edges,
+					p.samples ? 100.f * p.slewingSamples / p.samples : 0.f);
+			}));
+
+			menu->addChild(createMenuItem("Reset", "", [=]() {
+				module->profilerResetVersion++;
+			}));
+
+			menu->addChild(createMenuItem("Export...", "", [=]() {
+				char* path = osdialog_file(OSDIALOG_SAVE, NULL, "pinwheel-profile.json", NULL);
+				if (!path)
+					return;
+				json_t* profileJ = module->profileToJson();
+				if (json_dump_file(profileJ, path, JSON_INDENT(2)) != 0)
+					WARN("Could not write Pinwheel profile to %s", path);
+				json_decref(profileJ);
+				std::free(path);
+			}));
+		}));
+
+		menu->addChild(new MenuSeparator);
+
+		if (module->recorder.busy()) {
+			menu->addChild(new RecorderLabel(module));
+			menu->addChild(createMenuItem("Stop recording", "", [=]() {
+				module->recorder.stop();
+			}, !module->recorder.requested));
+		} else {
+			menu->addChild(createMenuItem("Record to WAV...", "", [=]() {
+				startRecording(module, PinwheelRecorder::WAV_FORMAT);
+			}));
+			menu->addChild(createMenuItem("Record to raw float...", "", [=]() {
+				startRecording(module, PinwheelRecorder::RAW_FORMAT);
+			}));
+		}
 	}
 };
 
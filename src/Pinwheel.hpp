@@ -0,0 +1,1610 @@
+#pragma once
+#include "plugin.hpp"
+#include "PinwheelRecorder.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PINWHEEL_HAVE_CYCLES 1
+#else
+#include <chrono>
+#endif
+
+using simd::float_4;
+using simd::int32_4;
+
+/** Single-producer single-consumer triple buffer.
+The writer fills its back slot and swaps it into the middle; the reader swaps the middle slot out only when
+something new was published. Neither side ever waits for the other or sees a half-written value. */
+template <typename T>
+struct TripleBuffer {
+    T slots[3];
+    // Slot shared between writer and reader, with freshBit set while it holds an unread value
+    std::atomic<int> middle{1};
+    int back = 0;
+    int front = 2;
+    static const int freshBit = 4;
+
+    T& write() {
+        return slots[back];
+    }
+
+    void publish() {
+        back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & 3;
+    }
+
+    /** Returns the latest published value, or the one returned last time if nothing new was published. */
+    const T& read() {
+        if (middle.load(std::memory_order_relaxed) & freshBit)
+            front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return slots[front];
+    }
+};
+
+/** What PinwheelProfiler has measured since it was last reset, published once per block. */
+struct PinwheelProfile {
+    // Costs under 8 ticks get a bucket each, then 4 buckets to the octave: bucket b from 12 on starts at
+    // (4 + b % 4) << (b / 4) >> 2 ticks, and buckets 8 to 11 stay empty
+    static const int buckets = 128;
+    uint64_t counts[buckets] = {};
+    // Cost of one process() call over the latest block, and since the reset
+    uint64_t blockP50 = 0;
+    uint64_t blockP99 = 0;
+    uint64_t blockMax = 0;
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t max = 0;
+    int64_t samples = 0;
+    int64_t blocks = 0;
+    // Rising edges on the gate outputs, over all channels
+    int64_t edges = 0;
+    // Samples spent with the speed or angle mod slew still moving on some channel
+    int64_t slewingSamples = 0;
+
+    static int bucket(uint64_t ticks) {
+        if (ticks < 8)
+            return (int) ticks;
+        int octave = std::min(63 - __builtin_clzll(ticks), buckets / 4 - 1);
+        return 4 * octave + ((ticks >> (octave - 2)) & 3);
+    }
+
+    static uint64_t bucketStart(int b) {
+        if (b < 8)
+            return b;
+        if (b < 12)
+            return 8;
+        return ((uint64_t) (4 + b % 4) << (b / 4)) >> 2;
+    }
+
+    /** First tick count past bucket b. */
+    static uint64_t bucketEnd(int b) {
+        return bucketStart(b + 1);
+    }
+
+    /** Cost that a fraction q of the calls stayed within, rounded up to the end of its bucket. */
+    template <typename T>
+    static uint64_t percentile(const T* counts, int64_t total, double q, uint64_t max) {
+        int64_t rank = (int64_t) std::ceil(q * total);
+        int64_t seen = 0;
+        for (int b = 0; b < buckets; b++) {
+            seen += counts[b];
+            if (seen >= rank)
+                return std::min(bucketEnd(b) - 1, max);
+        }
+        return max;
+    }
+
+    /** Unit of the costs: time-stamp counter ticks where there is one, nanoseconds elsewhere. */
+    static const char* unit() {
+#ifdef PINWHEEL_HAVE_CYCLES
+        return "cycles";
+#else
+        return "ns";
+#endif
+    }
+};
+
+/** Measures the cost of Pinwheel::process() on the engine thread, and hands a PinwheelProfile to the UI after
+every block of samples. Each call only bumps a histogram bucket; the percentiles are worked out once per block. */
+struct PinwheelProfiler {
+    static const int blockSize = 4096;
+    PinwheelProfile profile;
+    uint32_t blockCounts[PinwheelProfile::buckets] = {};
+    int blockSamples = 0;
+    uint64_t blockMax = 0;
+    TripleBuffer<PinwheelProfile> reports;
+
+    static uint64_t now() {
+#ifdef PINWHEEL_HAVE_CYCLES
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void reset() {
+        profile = PinwheelProfile();
+        std::fill(blockCounts, blockCounts + PinwheelProfile::buckets, 0);
+        blockSamples = 0;
+        blockMax = 0;
+        reports.write() = profile;
+        reports.publish();
+    }
+
+    void record(uint64_t ticks) {
+        int b = PinwheelProfile::bucket(ticks);
+        blockCounts[b]++;
+        blockMax = std::max(blockMax, ticks);
+        if (++blockSamples >= blockSize)
+            finishBlock();
+    }
+
+    void finishBlock() {
+        profile.blockP50 = PinwheelProfile::percentile(blockCounts, blockSamples, 0.5, blockMax);
+        profile.blockP99 = PinwheelProfile::percentile(blockCounts, blockSamples, 0.99, blockMax);
+        profile.blockMax = blockMax;
+        for (int b = 0; b < PinwheelProfile::buckets; b++) {
+            profile.counts[b] += blockCounts[b];
+            blockCounts[b] = 0;
+        }
+        profile.samples += blockSamples;
+        profile.blocks++;
+        profile.max = std::max(profile.max, blockMax);
+        profile.p50 = PinwheelProfile::percentile(profile.counts, profile.samples, 0.5, profile.max);
+        profile.p99 = PinwheelProfile::percentile(profile.counts, profile.samples, 0.99, profile.max);
+        blockSamples = 0;
+        blockMax = 0;
+
+        reports.write() = profile;
+        reports.publish();
+    }
+};
+
+/** One turn of a CV shape, from -1 to 1, sampled from the blade pointing right and linearly interpolated.
+Indexed directly by fixed-point phase; the extra point past the end saves wrapping the interpolation. */
+struct PinwheelWavetable {
+    static const int size = 256;
+    float values[size + 1] = {};
+
+    /** Samples shape(turns), for turns in [0, 1] from the blade pointing right. */
+    template <typename F>
+    void fill(F shape) {
+        for (int j = 0; j <= size; j++)
+            values[j] = shape((float) j / size);
+    }
+
+    /** Values at four fixed-point phases, gathered lane by lane. */
+    float_4 lookup(int32_4 phase) const {
+        // The top 8 bits of the phase index the table and the 24 below interpolate
+        int32_4 index = (phase >> 24) & (size - 1);
+        float_4 frac = float_4(phase & 0xffffff) * float(1.f / 16777216.f);
+        float_4 a, b;
+        for (int k = 0; k < 4; k++) {
+            a[k] = values[index[k]];
+            b[k] = values[index[k] + 1];
+        }
+        return a + frac * (b - a);
+    }
+};
+
+/** One detector stem: a window of blade angles over which the gate is open. */
+struct PinwheelDetector {
+    // Blade angle at the center of the window in radians, 1.5 pi being straight down
+    float position = 0.f;
+    float halfWidth = 0.f;
+};
+
+/** Detector windows cut at every edge into segments over one turn of fixed-point phase, sorted so a blade
+finds the detectors covering it with a binary search rather than testing each window. Segment k runs from
+start[k] up to end[k], which is start[k + 1] or a full turn for the last one. */
+struct PinwheelDetectorIndex {
+    static const int maxDetectors = 8;
+    static const int maxSegments = 32;
+    // Indexes up to this size are scanned rather than searched
+    static const int scanSegments = 8;
+    // Segment starts with the sign bit flipped, so signed compares order them as unsigned phases.
+    // Padded to a power of two with copies of the last segment.
+    int32_t bound[maxSegments] = {};
+    int32_t start[maxSegments] = {};
+    int32_t end[maxSegments] = {};
+    // Bit j is set where detector j covers the segment
+    int32_t mask[maxSegments] = {};
+    // Change of the gate at the segment's start and at its end: 1 opening, -1 closing, 0 none
+    float startStep[maxSegments] = {};
+    float endStep[maxSegments] = {};
+    int segments = 1;
+    int searchSize = 1;
+
+    void build(const PinwheelDetector* detectors, int count) {
+        uint32_t lo[maxDetectors];
+        uint32_t width[maxDetectors];
+        uint32_t edges[2 * maxDetectors + 1];
+        int n = 0;
+        // Phase 0 always starts a segment, so every phase has one to fall into
+        edges[n++] = 0;
+        for (int d = 0; d < count; d++) {
+            lo[d] = toPhase(detectors[d].position - detectors[d].halfWidth);
+            width[d] = toPhase(detectors[d].position + detectors[d].halfWidth) - lo[d] + 1;
+            edges[n++] = lo[d];
+            edges[n++] = lo[d] + width[d];
+        }
+        std::sort(edges, edges + n);
+        n = std::unique(edges, edges + n) - edges;
+
+        segments = n;
+        for (int k = 0; k < n; k++) {
+            start[k] = edges[k];
+            end[k] = edges[(k + 1) % n];
+            bound[k] = edges[k] ^ 0x80000000u;
+            mask[k] = 0;
+            for (int d = 0; d < count; d++) {
+                if (edges[k] - lo[d] < width[d])
+                    mask[k] |= 1 << d;
+            }
+        }
+        for (int k = 0; k < n; k++) {
+            float covered = mask[k] ? 1.f : 0.f;
+            startStep[k] = covered - (mask[(k + n - 1) % n] ? 1.f : 0.f);
+            endStep[k] = (mask[(k + 1) % n] ? 1.f : 0.f) - covered;
+        }
+
+        searchSize = 1;
+        while (searchSize < n)
+            searchSize *= 2;
+        for (int k = n; k < maxSegments; k++) {
+            bound[k] = INT32_MAX;
+            start[k] = start[n - 1];
+            end[k] = end[n - 1];
+            mask[k] = mask[n - 1];
+            startStep[k] = startStep[n - 1];
+            endStep[k] = endStep[n - 1];
+        }
+    }
+
+    /** Finds the segment holding each lane's phase, with its detector mask and both ends.
+    A few segments are cheaper to scan with broadcast compares than to gather from, so only larger indexes use the binary search. */
+    void find(int32_4 phase, int32_4& segment, int32_4& covering, int32_4& segmentStart, int32_4& segmentEnd) const {
+        int32_4 key = phase ^ INT32_MIN;
+        if (segments <= scanSegments) {
+            // Start at the last segment and step back once for every boundary still ahead of the phase
+            int last = segments - 1;
+            segment = last;
+            covering = mask[last];
+            segmentStart = start[last];
+            segmentEnd = end[last];
+            for (int s = last; s > 0; s--) {
+                int32_4 before = int32_4(bound[s]) > key;
+                segment += before;
+                covering -= before & int32_4(mask[s] - mask[s - 1]);
+                segmentStart -= before & int32_4((int32_t) ((uint32_t) start[s] - (uint32_t) start[s - 1]));
+                segmentEnd -= before & int32_4((int32_t) ((uint32_t) end[s] - (uint32_t) end[s - 1]));
+            }
+            return;
+        }
+        segment = 0;
+        for (int step = searchSize / 2; step > 0; step /= 2) {
+            int32_4 probe = segment + step;
+            segment = probe - (int32_4(step) & (gather(bound, probe) > key));
+        }
+        covering = gather(mask, segment);
+        segmentStart = gather(start, segment);
+        segmentEnd = gather(end, segment);
+    }
+
+    static int32_4 gather(const int32_t* table, int32_4 index) {
+        int32_4 v;
+        for (int k = 0; k < 4; k++)
+            v[k] = table[index[k]];
+        return v;
+    }
+
+    static float_4 gather(const float* table, int32_4 index) {
+        float_4 v;
+        for (int k = 0; k < 4; k++)
+            v[k] = table[index[k]];
+        return v;
+    }
+
+    static uint32_t toPhase(float angle) {
+        double turns = angle / (2.0 * M_PI);
+        turns -= std::floor(turns);
+        return (uint32_t) (int64_t) std::round(turns * 4294967296.0);
+    }
+};
+
+/** Everything the panel display draws, captured from the first channel at display rate. */
+struct PinwheelSnapshot {
+    float angle = 0.f;
+    int numberOfBlades = 4;
+    // Rotation of each blade relative to the rotor, including the angle mod
+    float bladeOffsets[8] = {};
+    // Bit i is set if gate i was high at any point since the previous snapshot
+    int gates = 0;
+    // Gate i follows detector i rather than blade i
+    bool detectorGates = false;
+    bool unipolar = false;
+};
+
+/** The last few seconds of the first channel's CV and gate outputs for PinwheelDisplay's scope view, min/max
+decimated to one column per display pixel, so its size follows the display rather than the sample rate.
+The engine folds each sample into a running column and only writes the ring when the column is complete, then
+publishes it by bumping the count. The UI draws the newest published columns; the spare ones give it several
+columns' time before the engine comes round to overwrite the oldest it might be reading. */
+struct PinwheelScope {
+    static const int columns = 120;
+    static const int ringColumns = 128;
+    static constexpr float seconds = 4.f;
+
+    struct Column {
+        float min[8];
+        float max[8];
+        // Bit i is set if gate i was high at any point in the column
+        int gates;
+    };
+
+    Column ring[ringColumns] = {};
+    // Columns completed since the module was created; the newest is ring[(published - 1) % ringColumns]
+    std::atomic<uint32_t> published{0};
+
+    // The column being filled, engine thread only
+    float_4 min[2] = {INFINITY, INFINITY};
+    float_4 max[2] = {-INFINITY, -INFINITY};
+    int gates = 0;
+    int samples = 0;
+    int samplesPerColumn = 1470;
+
+    void setSampleRate(float sampleRate) {
+        samplesPerColumn = std::max(1, (int) std::round(seconds * sampleRate / columns));
+    }
+
+    /** Engine thread: adds one sample of the eight CVs and the gate bits to the running column. */
+    void push(float_4 cv0, float_4 cv1, int gateBits) {
+        min[0] = simd::fmin(min[0], cv0);
+        min[1] = simd::fmin(min[1], cv1);
+        max[0] = simd::fmax(max[0], cv0);
+        max[1] = simd::fmax(max[1], cv1);
+        gates |= gateBits;
+        if (++samples < samplesPerColumn)
+            return;
+
+        uint32_t p = published.load(std::memory_order_relaxed);
+        Column& column = ring[p % ringColumns];
+        min[0].store(column.min);
+        min[1].store(column.min + 4);
+        max[0].store(column.max);
+        max[1].store(column.max + 4);
+        column.gates = gates;
+        published.store(p + 1, std::memory_order_release);
+
+        min[0] = min[1] = INFINITY;
+        max[0] = max[1] = -INFINITY;
+        gates = 0;
+        samples = 0;
+    }
+};
+
+/** Rotor state handed from Pinwheel down a chain of PinwheelExpanders, arriving one sample later at each hop. */
+struct PinwheelExpanderMessage {
+    // Set on the messages that carry detectorIndex. It only changes at a control tick, so it is sent when it
+    // does, or when the chain does, and each receiver keeps its own copy for the messages in between.
+    bool detectorIndexSent = false;
+    PinwheelDetectorIndex detectorIndex;
+
+    // Frame the sender processed, so a receiver can tell a fresh message from a stale one
+    int64_t frame = -1;
+    // Index of the receiving panel, 1 for the expander next to Pinwheel
+    int panel = 0;
+    int channels = 1;
+    bool trigMode = false;
+    bool unipolar = false;
+    bool audioRange = false;
+    bool detectorOutputs = false;
+    // Shape of each output, NULL for the triangle; also used for the same output on every expander
+    const PinwheelWavetable* shapeTables[8] = {};
+    float triggerSamples = 0.f;
+    // Per-channel rotor state after the sender's sample, and the ramps that carry it over to the next one
+    int32_4 phase[4] = {};
+    float_4 phaseStep[4] = {};
+    float_4 phaseStepDelta[4] = {};
+    int32_4 bladeSpacing[4] = {};
+    int32_4 bladeSpacingStep[4] = {};
+    float_4 angleModStep[4] = {};
+    float_4 bladesPerPanel[4] = {};
+    float_4 baseSpacing[4] = {};
+};
+
+struct Pinwheel : Module {
+	enum ParamId {
+		NUMBLADES_PARAM,
+		SPEED_PARAM,
+		MASS_PARAM,
+		BLADEANGLEMOD_PARAM,
+        RANGE_PARAM,
+        GATE_TRIG_PARAM,   
+        BIPOLAR_UNIPOLAR_PARAM,
+		RATIO_PARAM,
+		FRICTION_PARAM,
+		PARAMS_LEN
+	};
+	enum InputId {
+		SPEEDCVIN_INPUT,
+		NUMBLADESCVIN_INPUT,
+		MASSCVIN_INPUT,
+		BLADEANGLEMODCVIN_INPUT,
+		CLOCK_INPUT,
+		VOCT_INPUT,
+		WIND_INPUT,
+		GUST_INPUT,
+		INPUTS_LEN
+	};
+	enum OutputId {
+		GATE1OUT_OUTPUT,
+		GATE2OUT_OUTPUT,
+		GATE3OUT_OUTPUT,
+		GATE4OUT_OUTPUT,
+		GATE5OUT_OUTPUT,
+		GATE6OUT_OUTPUT,
+		GATE7OUT_OUTPUT,
+		GATE8OUT_OUTPUT,
+		CV1OUT_OUTPUT,
+		CV2OUT_OUTPUT,
+		CV3OUT_OUTPUT,
+		CV4OUT_OUTPUT,
+		CV5OUT_OUTPUT,
+		CV6OUT_OUTPUT,
+		CV7OUT_OUTPUT,
+		CV8OUT_OUTPUT,
+        DIRECTIONL_OUTPUT,
+		DIRECTIONR_OUTPUT,
+		ALLCV_OUTPUT,
+		ALLGATES_OUTPUT,
+		OUTPUTS_LEN
+	};
+	enum LightId {
+		GATE1LED_LIGHT,
+		GATE2LED_LIGHT,
+		GATE3LED_LIGHT,
+		GATE4LED_LIGHT,
+		GATE6LED_LIGHT,
+		GATE5LED_LIGHT,
+		GATE7LED_LIGHT,
+		GATE8LED_LIGHT,
+		CV1GREENLED_LIGHT,
+		CV1REDLED_LIGHT,
+		CV2GREENLED_LIGHT,
+		CV2REDLED_LIGHT,
+		CV3GREENLED_LIGHT,
+		CV3REDLED_LIGHT,
+		CV4GREENLED_LIGHT,
+		CV4REDLED_LIGHT,
+		CV5GREENLED_LIGHT,
+		CV5REDLED_LIGHT,
+		CV6GREENLED_LIGHT,
+		CV6REDLED_LIGHT,
+		CV7GREENLED_LIGHT,
+		CV7REDLED_LIGHT,
+		CV8GREENLED_LIGHT,
+		CV8REDLED_LIGHT,
+		DIRECTIONLLED_LIGHT,
+        DIRECTIONRLED_LIGHT,
+		SYNCLED_LIGHT,
+		LIGHTS_LEN
+	};
+	enum ShapeId {
+		TRIANGLE_SHAPE,
+		SINE_SHAPE,
+		SAW_SHAPE,
+		RAMP_SHAPE,
+		EXPONENTIAL_SHAPE,
+		STEPPED_SHAPE,
+		USER_SHAPE,
+		SHAPES_LEN
+	};
+
+    // Per-channel rotor state, one lane per polyphony channel (4 groups of float_4).
+    // The phase is fixed point, 2^32 to the turn, so it wraps for free and never drifts.
+    int32_4 phase[4] = {};
+    float_4 slewedSpeed[4] = {};
+    float_4 slewedAngleMod[4] = {};
+    float_4 prevGateState[8][4] = {};
+    float_4 triggerTimers[8][4] = {};
+    int channels = 1;
+
+    // Control-rate results, interpolated per sample until the next control tick
+    float_4 speedStep[4] = {};
+    float_4 angleModStep[4] = {};
+    float_4 numberOfBlades[4] = {};
+    float_4 baseSpacing[4] = {};
+    // Fixed-point phase between neighbouring blades, including the angle mod, and its per-sample ramp
+    int32_4 bladeSpacing[4] = {};
+    int32_4 bladeSpacingStep[4] = {};
+    bool trigMode = false;
+    bool unipolar = false;
+    bool audioRange = false;
+
+    // CV shape of every blade, and per-blade overrides where -1 follows it. Blade i of each expander uses shape i too.
+    int shape = TRIANGLE_SHAPE;
+    int bladeShapes[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+    // Table for each blade, resolved at control rate; NULL for the triangle, which is computed directly
+    const PinwheelWavetable* bladeTables[8] = {};
+
+    // User shape drawn in the context menu, one turn from the blade pointing up. The UI thread edits the
+    // points and bumps the version; the engine rebuilds its table at the next control tick.
+    static const int userShapePoints = 16;
+    float userShape[userShapePoints] = {};
+    std::atomic<int> userShapeVersion{0};
+    int userTableVersion = -1;
+    // Expanders read the published table through their messages, each hop a sample behind, so a rebuild goes
+    // into the spare and is then swapped in. The old table is only refilled once no message can still point
+    // to it, maxPanels samples after the swap.
+    PinwheelWavetable userTables[2];
+    const PinwheelWavetable* userTable = &userTables[0];
+    int userTableAge = maxPanels;
+
+    // Physical rotor, switched on from the context menu: the speed knob and CV set the wind it sits in, and the
+    // rotor's speed follows from torque, friction and inertia instead of a slew. See processRotor().
+    bool physics = false;
+    bool windConnected = false;
+    bool gustConnected = false;
+    dsp::TSchmittTrigger<float_4> gustTriggers[4];
+    // Set by the gust input at audio rate, consumed at the next control tick
+    float_4 gustPending[4] = {};
+    // Envelope of the latest gust, 1 at the trigger and dying away after
+    float_4 gustLevel[4] = {};
+
+    // Pinwheel plus attached expanders; every panel carries numberOfBlades blades of the same rotor
+    static const int maxPanels = 8;
+    int panels = 1;
+
+    // Clock sync: a phase-locked loop per channel, updated on each clock edge
+    bool clockSync = false;
+    int ratioIndex = 6;
+    float_4 syncDirection[4] = {};
+    float_4 prevClock[4] = {};
+    float_4 clockHigh[4] = {};
+    float_4 samplesSinceClock[4] = {};
+    float_4 clockPeriod[4] = {};
+    float_4 clockEdges[4] = {};
+    float_4 beatCount[4] = {};
+    float_4 syncStep[4] = {};
+
+    // Gate window of the original stem: the arc of blade angles over which the blade tip covers it
+    float gateCenter = 0.f;
+    float gateHalfWidth = 0.f;
+
+    // Detector stems, edited on the UI thread, which bumps the version; the engine rebuilds its index at the
+    // next control tick. Gate outputs follow either the blades, open in any window, or the detectors.
+    PinwheelDetector detectors[PinwheelDetectorIndex::maxDetectors];
+    int numDetectors = 1;
+    bool detectorOutputs = false;
+    // detectorOutputs as taken at the last control tick; the blade loop reads this, so a menu change can't
+    // land in the middle of a run of skipped gate evaluations
+    bool detectorGates = false;
+    std::atomic<int> detectorVersion{0};
+    int detectorIndexVersion = -1;
+    PinwheelDetectorIndex detectorIndex;
+    // Index version and chain length last sent to the expanders; cleared at every light tick so that an
+    // expander that missed the index, say while it was bypassed, gets it again soon after
+    int sentDetectorIndexVersion = -1;
+    int sentPanels = 0;
+
+    // Event-driven gates: number of samples each group can skip before a gate can change
+    bool eventDrivenGates = true;
+    int gateSkip[4] = {};
+    int gateSkipped[4] = {};
+
+    // Optional profiling of process(), switched on from the context menu. The UI bumps the reset version to
+    // clear it, and the engine starts over at the next control tick.
+    bool profiling = false;
+    std::atomic<int> profilerResetVersion{0};
+    int profilerVersion = -1;
+    PinwheelProfiler profiler;
+    // Gates of each output last time they were counted, one bit per lane
+    int profiledGates[8][4] = {};
+
+    // Set at control rate while either bundled output has a cable
+    bool bundledOutputs = false;
+
+    // Background recording of the first channel of every gate, CV and direction output, started from the context menu
+    PinwheelRecorder recorder;
+
+    // History for the display's scope view, only gathered while the view is shown
+    bool scopeView = false;
+    PinwheelScope scope;
+
+    // Blade loop for the current gate/trig mode, polarity, profiling and most blades on any channel, see processBlades().
+    // Blades past the loop's count are cleared once when it shrinks, rather than zeroed every sample.
+    typedef void (Pinwheel::*BladeKernel)(int g, int c, float_4 phaseStep);
+    BladeKernel bladeKernel = &Pinwheel::processBlades<false, false, false, 8>;
+    int kernelBlades = 8;
+    int kernelGates = 8;
+
+    int controlRateDivision = 16;
+    dsp::ClockDivider controlDivider;
+    dsp::ClockDivider lightDivider;
+    int gateLightMask = 0;
+
+    // Written by the engine thread, read by PinwheelDisplay on the UI thread
+    TripleBuffer<PinwheelSnapshot> displaySnapshot;
+
+    // Sample-rate dependent coefficients, see onSampleRateChange()
+    float sampleTime = 1.f / 44100.f;
+    float rotationPerSample = 8.f * M_PI / 44100.f;
+    float triggerSamples = 44.1f;
+
+
+    Pinwheel() {
+        config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
+        configParam(SPEED_PARAM, 0.f, 1.f, 0.5f, "Speed");
+        configParam(MASS_PARAM, 0.f, 1.f, 0.f, "Mass");
+        configSwitch(NUMBLADES_PARAM, 1.f, 8.f, 4.f, "Number of Blades", {"1", "2", "3", "4", "5", "6", "7", "8"});
+        configParam(BLADEANGLEMOD_PARAM, -1.f, 1.f, 0.f, "Blade Angle Mod");
+        configInput(SPEEDCVIN_INPUT, "Speed CV In");
+        configInput(MASSCVIN_INPUT, "Mass CV In");
+        configInput(NUMBLADESCVIN_INPUT, "Number of Blades CV In");
+        configInput(BLADEANGLEMODCVIN_INPUT, "Blade Angle Mod CV In");
+        configSwitch(RANGE_PARAM, 0.f, 2.f, 0.f, "Range", {"Slow", "Fast", "Audio"});
+        configSwitch(GATE_TRIG_PARAM, 0.f, 1.f, 0.f, "Gate/Trig", {"Gate", "Trig"});
+        configSwitch(BIPOLAR_UNIPOLAR_PARAM, 0.f, 1.f, 0.f, "Bipolar/Unipolar", {"Bipolar", "Unipolar"});
+        configSwitch(RATIO_PARAM, 0.f, 11.f, 6.f, "Rotations per beat",
+            {"1/16", "1/8", "1/4", "1/3", "1/2", "2/3", "1", "3/2", "2", "3", "4", "8"});
+        configInput(CLOCK_INPUT, "Clock");
+        configInput(VOCT_INPUT, "1V/octave pitch (Audio range)");
+        configParam(FRICTION_PARAM, 0.f, 1.f, 0.f, "Friction (physical rotor)", "%", 0.f, 100.f);
+        configInput(WIND_INPUT, "Wind torque (physical rotor)");
+        configInput(GUST_INPUT, "Gust trigger (physical rotor)");
+        configLight(SYNCLED_LIGHT, "Locked to clock");
+
+        configOutput(DIRECTIONL_OUTPUT, "Spinning Left");
+        configOutput(DIRECTIONR_OUTPUT, "Spinning Right");
+        configOutput(ALLCV_OUTPUT, "All CV, one channel per blade");
+        configOutput(ALLGATES_OUTPUT, "All Gates, one channel per gate output");
+
+        for (int i = 0; i < 8; i++) {
+            configOutput(GATE1OUT_OUTPUT + i, "Gate Out");
+            configOutput(CV1OUT_OUTPUT + i, "CV Out");
+        }
+
+        // The tip at radius side + flatHeight is over the stem when |x| <= stemWidth / 2 and y >= 0,
+        // i.e. within asin(stemWidth / 2 / tipRadius) of straight down
+        const float side = 25.f * 0.7f;
+        const float flatHeight = side * 0.866f;
+        const float tipRadius = side + flatHeight;
+        const float stemWidth = 5.f;
+        gateCenter = 1.5f * M_PI;
+        gateHalfWidth = std::asin(stemWidth / 2.f / tipRadius);
+
+        // The first detector is the original stem, and the others wait spread around it
+        for (int d = 0; d < PinwheelDetectorIndex::maxDetectors; d++) {
+            detectors[d].position = gateCenter + d * float(2.f * M_PI / PinwheelDetectorIndex::maxDetectors);
+            detectors[d].halfWidth = gateHalfWidth;
+        }
+
+        // The user shape starts out as a sine
+        for (int k = 0; k < userShapePoints; k++)
+            userShape[k] = std::cos(2.f * M_PI * k / userShapePoints);
+
+        controlDivider.setDivision(controlRateDivision);
+        lightDivider.setDivision(512);
+    }
+
+    void onSampleRateChange(const SampleRateChangeEvent& e) override {
+        sampleTime = e.sampleTime;
+        rotationPerSample = 8.f * M_PI * e.sampleTime;
+        triggerSamples = 0.001f * e.sampleRate;
+        scope.setSampleRate(e.sampleRate);
+        // Refresh lights at roughly display rate
+        lightDivider.setDivision(std::max(1, (int) (e.sampleRate / 60.f)));
+    }
+
+    // Reads knobs and CVs, advances the slews by one control period and sets up the per-sample ramps
+    void processControl() {
+        controlDivider.setDivision(controlRateDivision);
+        float controlSamples = controlRateDivision;
+        float controlTime = controlSamples * sampleTime;
+
+        // Every CV input may carry a poly cable; the widest one sets the number of rotors
+        channels = std::max(1, inputs[SPEEDCVIN_INPUT].getChannels());
+        channels = std::max(channels, inputs[MASSCVIN_INPUT].getChannels());
+        channels = std::max(channels, inputs[NUMBLADESCVIN_INPUT].getChannels());
+        channels = std::max(channels, inputs[BLADEANGLEMODCVIN_INPUT].getChannels());
+        channels = std::max(channels, inputs[CLOCK_INPUT].getChannels());
+        channels = std::max(channels, inputs[VOCT_INPUT].getChannels());
+        channels = std::max(channels, inputs[WIND_INPUT].getChannels());
+        channels = std::max(channels, inputs[GUST_INPUT].getChannels());
+
+        // Count the expanders chained to the right, each adding one panel of blades
+        panels = 1;
+        for (Module* m = rightExpander.module; m && m->model == modelPinwheelExpander && panels < maxPanels; m = m->rightExpander.module) {
+            panels++;
+        }
+
+        bool speedCVConnected = inputs[SPEEDCVIN_INPUT].isConnected();
+        bool massCVConnected = inputs[MASSCVIN_INPUT].isConnected();
+        bool numBladesCVConnected = inputs[NUMBLADESCVIN_INPUT].isConnected();
+        bool angleModCVConnected = inputs[BLADEANGLEMODCVIN_INPUT].isConnected();
+        windConnected = inputs[WIND_INPUT].isConnected();
+        gustConnected = inputs[GUST_INPUT].isConnected();
+
+        float speedKnobVoltage = rescale(params[SPEED_PARAM].getValue(), 0.f, 1.f, -5.f, 5.f);
+        float rangeSwitch = params[RANGE_PARAM].getValue();
+        float speedMultiplier = (rangeSwitch < 0.5f) ? 0.1f : 1.0f;
+        audioRange = rangeSwitch >= 1.5f;
+        float massKnobVoltage = rescale(params[MASS_PARAM].getValue(), 0.f, 1.f, -5.f, 5.f);
+        float numBladesKnob = rescale(params[NUMBLADES_PARAM].getValue(), 1.f, 8.f, -5.f, 5.f);
+        float angleModKnob = params[BLADEANGLEMOD_PARAM].getValue();
+        bool wasTrigMode = trigMode;
+        trigMode = params[GATE_TRIG_PARAM].getValue() >= 0.5f;
+        if (trigMode != wasTrigMode) {
+            resetGates();
+        }
+        bool wasSynced = clockSync;
+        clockSync = inputs[CLOCK_INPUT].isConnected();
+        if (wasSynced && !clockSync) {
+            resetClockSync();
+        }
+        ratioIndex = clamp((int) std::round(params[RATIO_PARAM].getValue()), 0, 11);
+        unipolar = params[BIPOLAR_UNIPOLAR_PARAM].getValue() >= 0.5f;
+
+        const float maxSlewTime = 1.f;
+        const float minSlewTime = 0.001f;
+
+        userTableAge = std::min(userTableAge + controlRateDivision, (int) maxPanels);
+        int version = userShapeVersion.load(std::memory_order_relaxed);
+        if (version != userTableVersion && userTableAge >= maxPanels) {
+            userTableVersion = version;
+            PinwheelWavetable* spare = &userTables[userTable == &userTables[0]];
+            spare->fill([&](float turns) { return userShapeValue(turns - 0.25f); });
+            userTable = spare;
+            userTableAge = 0;
+        }
+
+        version = detectorVersion.load(std::memory_order_relaxed);
+        if (version != detectorIndexVersion) {
+            detectorIndexVersion = version;
+            detectorIndex.build(detectors, clamp(numDetectors, 1, PinwheelDetectorIndex::maxDetectors));
+            // The windows moved, so the skip predicted from the old ones no longer holds
+            for (int g = 0; g < 4; g++) {
+                gateSkip[g] = 0;
+            }
+        }
+        if (detectorOutputs != detectorGates) {
+            detectorGates = detectorOutputs;
+            resetGates();
+        }
+
+        recorder.update();
+
+        version = profilerResetVersion.load(std::memory_order_relaxed);
+        if (version != profilerVersion) {
+            profilerVersion = version;
+            profiler.reset();
+        }
+        bool slewing = false;
+
+        for (int i = 0; i < 8; ++i) {
+            int bladeShape = clamp(bladeShapes[i] >= 0 ? bladeShapes[i] : shape, 0, SHAPES_LEN - 1);
+            bladeTables[i] = (bladeShape == TRIANGLE_SHAPE) ? NULL : (bladeShape == USER_SHAPE) ? userTable : &builtinTable(bladeShape);
+        }
+
+        for (int i = 0; i < 8; ++i) {
+            outputs[GATE1OUT_OUTPUT + i].setChannels(channels);
+            outputs[CV1OUT_OUTPUT + i].setChannels(channels);
+        }
+        outputs[DIRECTIONL_OUTPUT].setChannels(channels);
+        outputs[DIRECTIONR_OUTPUT].setChannels(channels);
+        bundledOutputs = outputs[ALLCV_OUTPUT].isConnected() || outputs[ALLGATES_OUTPUT].isConnected();
+
+        for (int c = 0; c < channels; c += 4) {
+            int g = c / 4;
+
+            float_4 speedCVVoltage = speedCVConnected ? simd::clamp(inputs[SPEEDCVIN_INPUT].getPolyVoltageSimd<float_4>(c), -5.f, 5.f) : 0.f;
+            float_4 combinedSpeedVoltage = simd::clamp(speedKnobVoltage + speedCVVoltage, -5.f, 5.f);
+            float_4 speedParam = (combinedSpeedVoltage + 5.f) / 10.f;
+            float_4 targetSpeed = (speedParam - 0.5f) * 2.f * speedMultiplier;
+
+            if (audioRange) {
+                // Speed knob and CV are octaves around C4, plus 1V/oct; a speed of 1 is 4 rotations per second
+                float_4 pitch = combinedSpeedVoltage + inputs[VOCT_INPUT].getPolyVoltageSimd<float_4>(c);
+                float_4 freq = dsp::FREQ_C4 * dsp::exp2_taylor5(simd::clamp(pitch, -10.f, 10.f));
+                freq = simd::fmin(freq, 0.25f / sampleTime);
+                targetSpeed = freq / 4.f;
+            }
+
+            float_4 massCVVoltage = massCVConnected ? simd::clamp(inputs[MASSCVIN_INPUT].getPolyVoltageSimd<float_4>(c), -5.f, 5.f) : 0.f;
+            float_4 combinedMassVoltage = simd::clamp(massKnobVoltage + massCVVoltage, -5.f, 5.f);
+            float_4 combinedMass = (combinedMassVoltage + 5.f) / 10.f;
+
+            // One-pole slew integrated over the whole control period
+            float_4 slewTime = minSlewTime + combinedMass * (maxSlewTime - minSlewTime);
+            float_4 slewAmount = 1.f - simd::exp(-controlTime / slewTime);
+            speedStep[g] = (targetSpeed - slewedSpeed[g]) * slewAmount / controlSamples;
+
+            // Synced, the speed knob only picks the direction and the clock sets the speed directly
+            syncDirection[g] = simd::ifelse(targetSpeed < 0.f, -1.f, 1.f);
+            if (clockSync) {
+                speedStep[g] = 0.f;
+            }
+
+            float_4 numBladesCV = numBladesCVConnected ? simd::clamp(inputs[NUMBLADESCVIN_INPUT].getPolyVoltageSimd<float_4>(c), -5.f, 5.f) : 0.f;
+            float_4 combinedNumBladesVoltage = simd::clamp(numBladesKnob + numBladesCV, -5.f, 5.f);
+            float_4 combinedNumBlades = 1.f + (combinedNumBladesVoltage + 5.f) / 10.f * 7.f;
+            numberOfBlades[g] = simd::clamp(simd::round(combinedNumBlades), 1.f, 8.f);
+            baseSpacing[g] = float(2.f * M_PI) / (numberOfBlades[g] * (float) panels);
+
+            // The physical rotor replaces the speed slew, except where the pitch or the clock sets the speed.
+            // Its inertia is the slew time at 4 blades on one panel, and grows with every blade added.
+            if (physics && !audioRange && !clockSync) {
+                float_4 inertia = slewTime * numberOfBlades[g] * (float) panels / 4.f;
+                speedStep[g] = (processRotor(g, c, targetSpeed, inertia, controlTime, speedMultiplier) - slewedSpeed[g]) / controlSamples;
+            }
+
+            float_4 angleModCV = angleModCVConnected ? simd::clamp(inputs[BLADEANGLEMODCVIN_INPUT].getPolyVoltageSimd<float_4>(c) / 5.f, -1.f, 1.f) : 0.f;
+            float_4 targetAngleMod = simd::clamp(angleModKnob + angleModCV, -1.f, 1.f);
+            angleModStep[g] = (targetAngleMod - slewedAngleMod[g]) * slewAmount / controlSamples;
+
+            // Restart the spacing ramp from the float slew, so its rounding can't build up
+            bladeSpacing[g] = angleToPhase(baseSpacing[g] * (1.f + slewedAngleMod[g]));
+            bladeSpacingStep[g] = angleToPhase(baseSpacing[g] * angleModStep[g]);
+
+            if (profiling) {
+                // A slew counts as moving until it is within 0.1% of its target; the clock sets the speed when synced
+                float_4 speedMoving = simd::fabs(targetSpeed - slewedSpeed[g]) > 1e-3f * simd::fmax(simd::fabs(targetSpeed), 1.f);
+                float_4 angleModMoving = simd::fabs(targetAngleMod - slewedAngleMod[g]) > 1e-3f;
+                float_4 moving = clockSync ? angleModMoving : (speedMoving | angleModMoving);
+                slewing |= (simd::movemask(moving) & ((1 << std::min(4, channels - c)) - 1)) != 0;
+            }
+
+            // Slews and blade layout just changed, so re-run the gate check on the next sample
+            gateSkip[g] = 0;
+
+            float_4 spinningRight = targetSpeed > 0.f;
+            float_4 spinningLeft = targetSpeed < 0.f;
+            outputs[DIRECTIONL_OUTPUT].setVoltageSimd(simd::ifelse(spinningLeft, 5.f, 0.f), c);
+            outputs[DIRECTIONR_OUTPUT].setVoltageSimd(simd::ifelse(spinningRight, 5.f, 0.f), c);
+        }
+
+        if (slewing) {
+            profiler.profile.slewingSamples += controlRateDivision;
+        }
+
+        // The bundles carry the first rotor, so their width follows its blade count
+        int bundledBlades = (int) numberOfBlades[0][0];
+        outputs[ALLCV_OUTPUT].setChannels(bundledBlades);
+        outputs[ALLGATES_OUTPUT].setChannels(detectorGates ? clamp(numDetectors, 1, 8) : bundledBlades);
+
+        selectBladeKernel();
+    }
+
+    /** Starts every gate output over, with no trigger running, when what drives the gates changes. The previous
+    state belongs to other blades or detectors, or to the other gate mode, so carrying it over would fire or cut
+    triggers that no edge caused. Also forces a gate evaluation on the next sample. */
+    void resetGates() {
+        for (int i = 0; i < 8; i++) {
+            for (int g = 0; g < 4; g++) {
+                prevGateState[i][g] = 0.f;
+                triggerTimers[i][g] = 0.f;
+            }
+        }
+        for (int g = 0; g < 4; g++) {
+            gateSkip[g] = 0;
+        }
+    }
+
+    /** Switches to the blade loop for the current modes. Blades it no longer runs get the zero outputs and idle
+    gate state that an inactive blade would have settled into. Detector gate outputs don't belong to blades. */
+    void selectBladeKernel() {
+        int blades = 1;
+        for (int c = 0; c < channels; c++) {
+            blades = std::max(blades, (int) numberOfBlades[c / 4][c % 4]);
+        }
+        int gates = detectorGates ? 8 : blades;
+
+        for (int i = blades; i < kernelBlades; i++) {
+            for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+                outputs[CV1OUT_OUTPUT + i].setVoltage(0.f, c);
+            }
+        }
+        for (int i = gates; i < kernelGates; i++) {
+            for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+                outputs[GATE1OUT_OUTPUT + i].setVoltage(0.f, c);
+            }
+            for (int g = 0; g < 4; g++) {
+                prevGateState[i][g] = 0.f;
+                triggerTimers[i][g] = 0.f;
+                profiledGates[i][g] = 0;
+            }
+        }
+        kernelBlades = blades;
+        kernelGates = gates;
+
+#define PINWHEEL_BLADE_KERNELS(TRIG, UNIPOLAR, PROFILED) { \
+            &Pinwheel::processBlades<TRIG, UNIPOLAR, PROFILED, 1>, &Pinwheel::processBlades<TRIG, UNIPOLAR, PROFILED, 2>, \
+            &Pinwheel::processBlades<TRIG, UNIPOLAR, PROFILED, 3>, &Pinwheel::processBlades<TRIG, UNIPOLAR, PROFILED, 4>, \
+            &Pinwheel::processBlades<TRIG, UNIPOLAR, PROFILED, 5>, &Pinwheel::processBlades<TRIG, UNIPOLAR, PROFILED, 6>, \
+            &Pinwheel::processBlades<TRIG, UNIPOLAR, PROFILED, 7>, &Pinwheel::processBlades<TRIG, UNIPOLAR, PROFILED, 8>}
+        static const BladeKernel kernels[2][2][2][8] = {
+            {
+                {PINWHEEL_BLADE_KERNELS(false, false, false), PINWHEEL_BLADE_KERNELS(false, false, true)},
+                {PINWHEEL_BLADE_KERNELS(false, true, false), PINWHEEL_BLADE_KERNELS(false, true, true)},
+            },
+            {
+                {PINWHEEL_BLADE_KERNELS(true, false, false), PINWHEEL_BLADE_KERNELS(true, false, true)},
+                {PINWHEEL_BLADE_KERNELS(true, true, false), PINWHEEL_BLADE_KERNELS(true, true, true)},
+            },
+        };
+#undef PINWHEEL_BLADE_KERNELS
+        bladeKernel = kernels[trigMode][unipolar][profiling][blades - 1];
+    }
+
+    /** With the profiler off this is the only check for it per sample: the timing lives in its own path, and the
+    edge counting in the blade loop instance that processControl() picks. */
+    void process(const ProcessArgs& args) override {
+        if (profiling) {
+            uint64_t startTicks = PinwheelProfiler::now();
+            processSample(args);
+            profiler.record(PinwheelProfiler::now() - startTicks);
+        } else {
+            processSample(args);
+        }
+    }
+
+    void processSample(const ProcessArgs& args) {
+        if (controlDivider.process()) {
+            processControl();
+        }
+
+        for (int c = 0; c < channels; c += 4) {
+            int g = c / 4;
+
+            if (clockSync) {
+                processClock(g, c);
+            }
+
+            // Gusts are triggers, so they are caught every sample and applied at the next control tick
+            if (gustConnected) {
+                gustPending[g] |= gustTriggers[g].process(inputs[GUST_INPUT].getPolyVoltageSimd<float_4>(c), 0.1f, 1.f);
+            }
+
+            slewedSpeed[g] += speedStep[g];
+            slewedAngleMod[g] += angleModStep[g];
+            bladeSpacing[g] += bladeSpacingStep[g];
+
+            float_4 phaseStep = slewedSpeed[g] * rotationPerSample;
+            phase[g] += angleToPhase(phaseStep);
+
+            // The blades, through the loop compiled for the current modes
+            (this->*bladeKernel)(g, c, phaseStep);
+        }
+
+        if (bundledOutputs) {
+            processBundledOutputs();
+        }
+
+        if (recorder.recording) {
+            recordFrame();
+        }
+
+        if (scopeView) {
+            processScope();
+        }
+
+        // Hand the rotor on to an attached expander, which picks it up on the next sample
+        if (rightExpander.module && rightExpander.module->model == modelPinwheelExpander) {
+            sendExpanderMessage(args.frame);
+        }
+
+        if (lightDivider.process()) {
+            sentDetectorIndexVersion = -1;
+            publishSnapshot();
+            processLights(sampleTime * lightDivider.getDivision());
+        }
+    }
+
+    /** Blade loop and gate bookkeeping for group g, compiled for every combination of gate/trig, polarity, profiling
+    and blade count so the loop has a fixed length and no mode checks. processControl() picks the instance. */
+    template <bool TRIG, bool UNIPOLAR, bool PROFILED, int BLADES>
+    void processBlades(int g, int c, float_4 phaseStep) {
+        // Between predicted edges the gates can't change, so only the CVs need computing
+        // Band-limited gates need every sample around their edges, so Audio range evaluates them all
+        bool evaluateGates = !eventDrivenGates || audioRange || gateSkipped[g] >= gateSkip[g];
+        float elapsedSamples = gateSkipped[g] + 1;
+        float_4 samplesToEdge = INFINITY;
+        int32_4 detectorsCovered = 0;
+
+        int32_4 bladePhase = phase[g];
+        for (int i = 0; i < BLADES; ++i, bladePhase += bladeSpacing[g]) {
+            float_4 bladeActive = (float) i < numberOfBlades[g];
+
+            float_4 CVout = bladeTables[i] ? shapeCV(*bladeTables[i], bladePhase, UNIPOLAR) : bladeCV(bladePhase, UNIPOLAR);
+
+            // Phase travelled by this blade per sample, including the angle mod ramp
+            float_4 bladeStep = phaseStep + baseSpacing[g] * (float) i * angleModStep[g];
+
+            if (audioRange && !bladeTables[i]) {
+                CVout += bandlimitCV(bladePhase, bladeStep, UNIPOLAR);
+            }
+
+            outputs[CV1OUT_OUTPUT + i].setVoltageSimd(simd::ifelse(bladeActive, CVout, 0.f), c);
+
+            if (!evaluateGates)
+                continue;
+
+            // The detector segment the blade is in, and how far it is from either end
+            int32_4 segment, covering, segmentStart, segmentEnd;
+            detectorIndex.find(bladePhase, segment, covering, segmentStart, segmentEnd);
+            float_4 sinceStart = phaseDistance(bladePhase - segmentStart);
+            float_4 untilEnd = phaseDistance(segmentEnd - bladePhase);
+
+            if (detectorGates) {
+                detectorsCovered |= covering & int32_4::cast(bladeActive);
+            } else {
+                float_4 gateActive = float_4::cast(covering > 0);
+                float_4 pastEdge = simd::ifelse(bladeStep < 0.f, untilEnd, sinceStart);
+                float_4 gateOut = processGate<TRIG, PROFILED>(i, g, gateActive, bladeActive, pastEdge, bladeStep, elapsedSamples, samplesToEdge);
+
+                float_4 gateVoltage = simd::ifelse(gateOut, 5.f, 0.f);
+                if (audioRange && !TRIG) {
+                    gateVoltage = simd::ifelse(bladeActive, gateVoltage + bandlimitGate(detectorIndex, segment, sinceStart, untilEnd, bladeStep), 0.f);
+                }
+                outputs[GATE1OUT_OUTPUT + i].setVoltageSimd(gateVoltage, c);
+            }
+
+            if (eventDrivenGates) {
+                // Worst-case samples until this blade reaches either end of its segment, assuming the speed
+                // and angle mod ramps run to the end of the control period
+                float_4 speedEnd = slewedSpeed[g] + speedStep[g] * (float) controlRateDivision;
+                float_4 maxStep = simd::fmax(simd::fabs(slewedSpeed[g]), simd::fabs(speedEnd)) * rotationPerSample
+                    + baseSpacing[g] * (float) i * simd::fabs(angleModStep[g]);
+                float_4 edgeDistance = simd::fmin(sinceStart, untilEnd);
+                samplesToEdge = simd::ifelse(bladeActive, simd::fmin(samplesToEdge, edgeDistance / maxStep), samplesToEdge);
+            }
+        }
+
+        if (evaluateGates && detectorGates) {
+            // Each gate output follows one detector, open while any blade is in its window
+            for (int j = 0; j < 8; ++j) {
+                float_4 gateActive = float_4::cast((detectorsCovered & (1 << j)) > 0);
+                float_4 gateOut = processGate<TRIG, PROFILED>(j, g, gateActive, float_4::mask(), 0.f, phaseStep, elapsedSamples, samplesToEdge);
+                outputs[GATE1OUT_OUTPUT + j].setVoltageSimd(simd::ifelse(gateOut, 5.f, 0.f), c);
+            }
+        }
+
+        if (evaluateGates) {
+            gateSkipped[g] = 0;
+            gateSkip[g] = 0;
+            if (eventDrivenGates) {
+                float minSamples = INFINITY;
+                for (int k = 0; k < std::min(4, channels - c); k++) {
+                    minSamples = std::min(minSamples, samplesToEdge[k]);
+                }
+                // Stay one sample short of the earliest possible edge
+                gateSkip[g] = (int) std::min(std::floor(minSamples) - 1.f, (float) controlRateDivision);
+            }
+        } else {
+            gateSkipped[g]++;
+        }
+    }
+
+    /** Queues the first channel of the gate, CV and direction outputs, in that order, for the recorder. */
+    void recordFrame() {
+        static_assert(DIRECTIONR_OUTPUT + 1 == PinwheelRecorder::channels, "The recorder takes every output up to the direction outputs");
+        float frame[PinwheelRecorder::channels];
+        for (int o = 0; o < PinwheelRecorder::channels; o++) {
+            frame[o] = outputs[o].getVoltage(0);
+        }
+        recorder.push(frame);
+    }
+
+    /** Adds the first channel of the CV and gate outputs to the scope history. */
+    void processScope() {
+        float cv[8];
+        int gates = 0;
+        for (int i = 0; i < 8; i++) {
+            cv[i] = outputs[CV1OUT_OUTPUT + i].getVoltage(0);
+            gates |= (outputs[GATE1OUT_OUTPUT + i].getVoltage(0) > 0.f) << i;
+        }
+        scope.push(float_4::load(cv), float_4::load(cv + 4), gates);
+    }
+
+    /** Copies the first channel of each CV and gate output onto the All CV and All Gates cables. Skipped gate
+    evaluations leave the gate outputs holding their last value, so the bundle stays right on those samples too. */
+    void processBundledOutputs() {
+        float cv[8];
+        float gates[8];
+        for (int i = 0; i < 8; i++) {
+            cv[i] = outputs[CV1OUT_OUTPUT + i].getVoltage(0);
+            gates[i] = outputs[GATE1OUT_OUTPUT + i].getVoltage(0);
+        }
+        outputs[ALLCV_OUTPUT].setVoltageSimd(float_4::load(cv), 0);
+        outputs[ALLCV_OUTPUT].setVoltageSimd(float_4::load(cv + 4), 4);
+        outputs[ALLGATES_OUTPUT].setVoltageSimd(float_4::load(gates), 0);
+        outputs[ALLGATES_OUTPUT].setVoltageSimd(float_4::load(gates + 4), 4);
+    }
+
+    /** Turns gateActive into the gate or trigger of gate output i for group g, latches it for the panel light and,
+    when PROFILED, counts its rising edges. Forced inline, since GCC otherwise leaves it out of line in the larger
+    trig kernels. */
+    template <bool TRIG, bool PROFILED>
+    __attribute__((always_inline)) inline float_4 processGate(int i, int g, float_4 gateActive, float_4 bladeActive, float_4 pastEdge, float_4 bladeStep,
+            float elapsedSamples, float_4& samplesToEdge) {
+        float_4 gateOut;
+        if (!TRIG) {
+            gateOut = gateActive;
+        } else {
+            // Catch up on the countdown skipped since the last evaluation
+            triggerTimers[i][g] -= simd::ifelse(triggerTimers[i][g] > 0.f, elapsedSamples - 1.f, 0.f);
+
+            gateOut = processTrigger(gateActive, bladeActive, pastEdge, bladeStep, triggerSamples,
+                prevGateState[i][g], triggerTimers[i][g]);
+
+            // A running trigger must end on time
+            samplesToEdge = simd::ifelse(gateOut, simd::fmin(samplesToEdge, triggerTimers[i][g]), samplesToEdge);
+        }
+        gateOut = gateOut & bladeActive;
+
+        if (PROFILED) {
+            int gates = simd::movemask(gateOut) & ((1 << std::min(4, channels - 4 * g)) - 1);
+            profiler.profile.edges += __builtin_popcount(gates & ~profiledGates[i][g]);
+            profiledGates[i][g] = gates;
+        }
+
+        // Latch short triggers so the panel lights still see them at display rate
+        if (g == 0) {
+            gateLightMask |= (simd::movemask(gateOut) & 1) << i;
+        }
+        return gateOut;
+    }
+
+    /** Advances the physical rotor of group g by one control period and returns its speed at the end of it.
+    The wind drags the rotor towards windSpeed, the wind input and gusts add torque, viscous friction adds drag
+    and Coulomb friction takes a fixed amount of speed per second, enough to hold the rotor still in a light
+    wind. Without friction or torque it settles exactly like the slew. The linear terms are integrated exactly
+    over the period, so the step is stable for any inertia and control rate, and the per-sample ramp to the
+    result costs no more than the slew's. */
+    float_4 processRotor(int g, int c, float_4 windSpeed, float_4 inertia, float controlTime, float speedMultiplier) {
+        const float gustTime = 0.1f;
+        const float gustTorque = 2.f;
+        gustLevel[g] = simd::ifelse(gustPending[g], 1.f, gustLevel[g] * std::exp(-controlTime / gustTime));
+        gustPending[g] = 0.f;
+
+        // Torque in the same units as the speed, so 5 V of wind pushes like the speed knob turned fully up
+        float_4 torque = windConnected ? simd::clamp(inputs[WIND_INPUT].getPolyVoltageSimd<float_4>(c), -10.f, 10.f) / 5.f : 0.f;
+        torque = (torque + gustLevel[g] * gustTorque * syncDirection[g]) * speedMultiplier;
+
+        float friction = params[FRICTION_PARAM].getValue();
+        float drag = 1.f + 4.f * friction;
+        float_4 terminalSpeed = (windSpeed + torque) / drag;
+        float_4 speed = terminalSpeed + (slewedSpeed[g] - terminalSpeed) * simd::exp(-drag * controlTime / inertia);
+
+        float_4 stiction = 0.5f * friction * speedMultiplier * controlTime / inertia;
+        return simd::ifelse(speed > 0.f, simd::fmax(speed - stiction, 0.f), simd::fmin(speed + stiction, 0.f));
+    }
+
+    /** Forgets the lock when the clock is unpatched, so a clock patched in later starts again from its first
+    edge. processClock() only runs while synced, so its own timeout never sees the clock go away. */
+    void resetClockSync() {
+        for (int g = 0; g < 4; g++) {
+            prevClock[g] = 0.f;
+            clockHigh[g] = 0.f;
+            samplesSinceClock[g] = 0.f;
+            clockPeriod[g] = 0.f;
+            clockEdges[g] = 0.f;
+            beatCount[g] = 0.f;
+            syncStep[g] = 0.f;
+        }
+    }
+
+    /** Runs the clock PLL for one group. On each rising clock edge the measured beat period sets the speed,
+    and the phase error against beatCount * ratio is worked off over the following beat. The target phase
+    is derived from the beat count rather than accumulated, so the rotor can't drift from the clock. */
+    void processClock(int g, int c) {
+        // Rotations per beat for each RATIO_PARAM position
+        static const int ratioNumerators[12] = {1, 1, 1, 1, 1, 2, 1, 3, 2, 3, 4, 8};
+        static const int ratioDenominators[12] = {16, 8, 4, 3, 2, 3, 1, 2, 1, 1, 1, 1};
+
+        const float twoPi = 2.f * M_PI;
+        float_4 clock = inputs[CLOCK_INPUT].getPolyVoltageSimd<float_4>(c);
+        samplesSinceClock[g] += 1.f;
+
+        float_4 rising = simd::ifelse(clockHigh[g], 0.f, clock >= 1.f);
+        clockHigh[g] = simd::ifelse(clockHigh[g], clock > 0.1f, clock >= 1.f);
+        float_4 lastClock = prevClock[g];
+        prevClock[g] = clock;
+
+        // A clock that stopped for several beats has to lock again from scratch
+        float_4 timedOut = (clockPeriod[g] > 0.f) & (samplesSinceClock[g] > 4.f * clockPeriod[g]);
+        clockEdges[g] = simd::ifelse(timedOut, 0.f, clockEdges[g]);
+        clockPeriod[g] = simd::ifelse(timedOut, 0.f, clockPeriod[g]);
+
+        if (!simd::movemask(rising))
+            return;
+
+        // The threshold was crossed a fraction of a sample before now
+        float_4 fraction = simd::clamp((clock - 1.f) / (clock - lastClock), 0.f, 1.f);
+        float_4 period = samplesSinceClock[g] - fraction;
+
+        // The first edge after (re)starting the clock is beat 0, where every blade is at its rest angle
+        float_4 first = clockEdges[g] < 1.f;
+        float_4 second = clockEdges[g] < 2.f;
+        float num = ratioNumerators[ratioIndex];
+        float den = ratioDenominators[ratioIndex];
+        float_4 nextBeat = beatCount[g] + 1.f;
+        nextBeat = simd::ifelse(first | (nextBeat >= den), 0.f, nextBeat);
+        float_4 turns = nextBeat * num;
+        turns -= den * simd::floor(turns / den);
+        float_4 target = syncDirection[g] * twoPi * turns / den;
+
+        // Phase the rotor had at the crossing, and how far it is from where the clock says it should be
+        float_4 step = slewedSpeed[g] * rotationPerSample;
+        int32_4 edgePhase = phase[g] + angleToPhase(step * (1.f - fraction));
+        float_4 phaseError = phaseToTurns(angleToPhase(target) - edgePhase) * twoPi;
+
+        // First edge: jump to the target phase. Second edge: take the period as is. Later edges: smooth it.
+        float_4 measuredStep = syncDirection[g] * twoPi * (num / den) / period;
+        syncStep[g] = simd::ifelse(second, measuredStep, syncStep[g] + 0.5f * (measuredStep - syncStep[g]));
+        float_4 correction = simd::ifelse(second, 0.f, 0.5f * phaseError / period);
+        float_4 newSpeed = simd::ifelse(first, 0.f, (syncStep[g] + correction) / rotationPerSample);
+        int32_4 syncPhase = angleToPhase(target + newSpeed * rotationPerSample * (fraction - 1.f));
+        phase[g] = int32_4::cast(simd::ifelse(rising & second, float_4::cast(syncPhase), float_4::cast(phase[g])));
+
+        slewedSpeed[g] = simd::ifelse(rising, newSpeed, slewedSpeed[g]);
+        clockPeriod[g] = simd::ifelse(first, clockPeriod[g], simd::ifelse(rising, period, clockPeriod[g]));
+        clockEdges[g] = simd::ifelse(rising, simd::fmin(clockEdges[g] + 1.f, 2.f), clockEdges[g]);
+        beatCount[g] = simd::ifelse(rising, nextBeat, beatCount[g]);
+        samplesSinceClock[g] = simd::ifelse(rising, fraction, samplesSinceClock[g]);
+
+        // The speed changed mid control period, so the gate prediction no longer holds
+        gateSkip[g] = 0;
+    }
+
+    /** Converts an angle in radians, of any size, to fixed-point phase. */
+    static int32_4 angleToPhase(float_4 a) {
+        float_4 turns = a * float(1.f / (2.f * M_PI));
+        turns -= simd::round(turns);
+        // Half a turn overflows the conversion to INT32_MIN, which is half a turn as well
+        return int32_4(simd::round(turns * 4294967296.f));
+    }
+
+    /** Signed turns of a fixed-point phase or phase difference, in [-0.5, 0.5). */
+    static float_4 phaseToTurns(int32_4 phase) {
+        return float_4(phase) * float(1.0 / 4294967296.0);
+    }
+
+    /** Angle of a fixed-point phase in [0, 2pi), for the display. */
+    static float_4 phaseToAngle(int32_4 phase) {
+        float_4 turns = phaseToTurns(phase);
+        turns += simd::ifelse(turns < 0.f, 1.f, 0.f);
+        return turns * float(2.f * M_PI);
+    }
+
+    /** Forward distance in radians covered by an unsigned fixed-point phase difference, in [0, 2pi). */
+    static float_4 phaseDistance(int32_4 difference) {
+        return float_4((difference >> 1) & 0x7fffffff) * float(2.0 * M_PI / 2147483648.0);
+    }
+
+    /** Triangle CV of a blade at bladePhase: +5 V pointing up, -5 V pointing down, 0 to 5 V when unipolar. */
+    static float_4 bladeCV(int32_4 bladePhase, bool unipolar) {
+        // Signed turns from pointing up, where the wrap needs no branch
+        float_4 fromPeak = phaseToTurns(bladePhase - (1 << 30));
+        float_4 CVout = 5.f - 20.f * simd::fabs(fromPeak);
+
+        if (unipolar) {
+            CVout = (CVout + 5.f) * 0.5f;
+        }
+        return CVout;
+    }
+
+    /** CV of a blade at bladePhase looked up in one of the shape tables, scaled like bladeCV(). */
+    static float_4 shapeCV(const PinwheelWavetable& table, int32_4 bladePhase, bool unipolar) {
+        float_4 CVout = 5.f * table.lookup(bladePhase);
+        if (unipolar) {
+            CVout = (CVout + 5.f) * 0.5f;
+        }
+        return CVout;
+    }
+
+    /** Built-in shape at turns from the blade pointing up, from -1 to 1. Only used to fill the tables. */
+    static float builtinShapeValue(int shapeId, float turns) {
+        float u = turns - std::floor(turns);
+        float triangle = 1.f - 4.f * std::min(u, 1.f - u);
+        switch (shapeId) {
+            case SINE_SHAPE: return std::cos(2.f * M_PI * u);
+            case SAW_SHAPE: return 1.f - 2.f * u;
+            case RAMP_SHAPE: return 2.f * u - 1.f;
+            // Sharp peak pointing up, resting low for most of the turn
+            case EXPONENTIAL_SHAPE: return -1.f + 2.f * std::expm1(2.f * (triangle + 1.f)) / std::expm1(4.f);
+            // The triangle held for each eighth of a turn
+            case STEPPED_SHAPE: {
+                float step = std::floor(u * 8.f) / 8.f;
+                return 1.f - 4.f * std::min(step, 1.f - step);
+            }
+            default: return triangle;
+        }
+    }
+
+    /** User shape at turns from the blade pointing up, linearly interpolated between its points. */
+    float userShapeValue(float turns) const {
+        float pos = (turns - std::floor(turns)) * userShapePoints;
+        int k = std::min((int) pos, userShapePoints - 1);
+        float a = userShape[k];
+        float b = userShape[(k + 1) % userShapePoints];
+        return clamp(a + (pos - k) * (b - a), -1.f, 1.f);
+    }
+
+    /** Table of a built-in shape, shared by every instance and filled on first use. */
+    static const PinwheelWavetable& builtinTable(int shapeId) {
+        struct BuiltinTables {
+            PinwheelWavetable tables[SHAPES_LEN];
+            BuiltinTables() {
+                for (int s = 0; s < SHAPES_LEN; s++)
+                    tables[s].fill([=](float turns) { return builtinShapeValue(s, turns - 0.25f); });
+            }
+        };
+        static const BuiltinTables builtinTables;
+        return builtinTables.tables[shapeId];
+    }
+
+    /** Polynomial approximation of the band-limited step residual, for a step of 2 at phase 0.
+    t is the phase in turns and dt the phase increment per sample. */
+    static float_4 polyBlep(float_4 t, float_4 dt) {
+        float_4 after = t / dt;
+        float_4 before = (t - 1.f) / dt;
+        return simd::ifelse(t < dt, after + after - after * after - 1.f,
+            simd::ifelse(t > 1.f - dt, before * before + before + before + 1.f, 0.f));
+    }
+
+    /** Integrated polyBlep, the residual of a slope change of 4 turns^-1 at phase 0. */
+    static float_4 polyBlamp(float_4 t, float_4 dt) {
+        float_4 after = t / dt - 1.f;
+        float_4 before = (t - 1.f) / dt + 1.f;
+        return simd::ifelse(t < dt, -1.f / 3.f * after * after * after,
+            simd::ifelse(t > 1.f - dt, 1.f / 3.f * before * before * before, 0.f));
+    }
+
+    /** Correction that rounds off the triangle CV's corners to remove aliasing at audio rates. */
+    static float_4 bandlimitCV(int32_4 bladePhase, float_4 bladeStep, bool unipolar) {
+        // Turns since the CV peak, counted in the direction of travel; the triangle is symmetric about its peak
+        float_4 dt = simd::fabs(bladeStep) * float(1.f / (2.f * M_PI));
+        float_4 peak = phaseToTurns(bladePhase - (1 << 30));
+        peak = simd::ifelse(bladeStep < 0.f, -peak, peak);
+        peak += simd::ifelse(peak < 0.f, 1.f, 0.f);
+        float_4 trough = peak + 0.5f;
+        trough -= simd::ifelse(trough >= 1.f, 1.f, 0.f);
+
+        float amplitude = unipolar ? 2.5f : 5.f;
+        return amplitude * 4.f * dt * (polyBlamp(trough, dt) - polyBlamp(peak, dt));
+    }
+
+    /** Correction that band-limits the 5 V steps where a blade enters and leaves detector windows. Only the
+    edges of the blade's own segment can be within a sample of it. */
+    static float_4 bandlimitGate(const PinwheelDetectorIndex& index, int32_4 segment, float_4 sinceStart, float_4 untilEnd, float_4 bladeStep) {
+        float_4 dt = simd::fabs(bladeStep) * float(1.f / (2.f * M_PI));
+        float_4 startStep = PinwheelDetectorIndex::gather(index.startStep, segment);
+        float_4 endStep = PinwheelDetectorIndex::gather(index.endStep, segment);
+
+        // Turns since the edge behind the blade and until the one ahead, in its direction of travel
+        float_4 backward = bladeStep < 0.f;
+        float_4 behind = simd::ifelse(backward, untilEnd, sinceStart) * float(1.f / (2.f * M_PI));
+        float_4 ahead = simd::ifelse(backward, sinceStart, untilEnd) * float(1.f / (2.f * M_PI));
+        float_4 behindStep = simd::ifelse(backward, -endStep, startStep);
+        float_4 aheadStep = simd::ifelse(backward, -startStep, endStep);
+
+        return 2.5f * (behindStep * polyBlep(simd::fmin(behind, 0.5f), dt) + aheadStep * polyBlep(1.f - simd::fmin(ahead, 0.5f), dt));
+    }
+
+    /** Trig mode: starts a pulse of triggerSamples on each rising edge of gateActive and counts it down.
+    pastEdge is how far the blade has travelled into the window. Returns the trigger output mask. */
+    static float_4 processTrigger(float_4 gateActive, float_4 bladeActive, float_4 pastEdge, float_4 bladeStep,
+            float triggerSamples, float_4& prevGateState, float_4& triggerTimer) {
+        // Start the trigger at the exact crossing, a fraction of a sample ago
+        float_4 gateRisingEdge = simd::ifelse(prevGateState, 0.f, gateActive);
+        float_4 edgeFraction = simd::clamp(pastEdge / simd::fabs(bladeStep), 0.f, 1.f);
+        triggerTimer = simd::ifelse(gateRisingEdge, triggerSamples - edgeFraction, triggerTimer);
+        prevGateState = gateActive & bladeActive;
+
+        float_4 gateOut = triggerTimer > 0.f;
+        triggerTimer = simd::ifelse(gateOut & bladeActive, triggerTimer - 1.f, 0.f);
+        return gateOut;
+    }
+
+    void sendExpanderMessage(int64_t frame) {
+        Module* expander = rightExpander.module;
+        PinwheelExpanderMessage* message = (PinwheelExpanderMessage*) expander->leftExpander.producerMessage;
+        message->frame = frame;
+        message->panel = 1;
+        message->channels = channels;
+        message->trigMode = trigMode;
+        message->unipolar = unipolar;
+        message->audioRange = audioRange;
+        for (int i = 0; i < 8; i++) {
+            message->shapeTables[i] = bladeTables[i];
+        }
+        message->detectorOutputs = detectorGates;
+        message->detectorIndexSent = detectorIndexVersion != sentDetectorIndexVersion || panels != sentPanels;
+        if (message->detectorIndexSent) {
+            message->detectorIndex = detectorIndex;
+            sentDetectorIndexVersion = detectorIndexVersion;
+            sentPanels = panels;
+        }
+        message->triggerSamples = triggerSamples;
+        for (int g = 0; g < 4; g++) {
+            message->phase[g] = phase[g];
+            message->phaseStep[g] = slewedSpeed[g] * rotationPerSample;
+            message->phaseStepDelta[g] = speedStep[g] * rotationPerSample;
+            message->bladeSpacing[g] = bladeSpacing[g];
+            message->bladeSpacingStep[g] = bladeSpacingStep[g];
+            message->angleModStep[g] = angleModStep[g];
+            message->bladesPerPanel[g] = numberOfBlades[g];
+            message->baseSpacing[g] = baseSpacing[g];
+        }
+        expander->leftExpander.requestMessageFlip();
+    }
+
+    void publishSnapshot() {
+        PinwheelSnapshot& snapshot = displaySnapshot.write();
+        snapshot.angle = phaseToAngle(phase[0])[0];
+        snapshot.numberOfBlades = clamp((int) numberOfBlades[0][0], 1, 8);
+        snapshot.gates = gateLightMask;
+        snapshot.detectorGates = detectorGates;
+        snapshot.unipolar = unipolar;
+        for (int i = 0; i < 8; ++i) {
+            snapshot.bladeOffsets[i] = baseSpacing[0][0] * i * (1.f + slewedAngleMod[0][0]);
+            if (outputs[GATE1OUT_OUTPUT + i].getVoltage(0) > 0.f)
+                snapshot.gates |= 1 << i;
+        }
+        displaySnapshot.publish();
+    }
+
+    // Panel lights follow the first channel
+    void processLights(float lightTime) {
+        for (int i = 0; i < 8; ++i) {
+            float CVout = outputs[CV1OUT_OUTPUT + i].getVoltage(0);
+            bool gate = (gateLightMask & (1 << i)) || outputs[GATE1OUT_OUTPUT + i].getVoltage(0) > 0.f;
+            lights[GATE1LED_LIGHT + i].setBrightnessSmooth(gate ? 1.f : 0.f, lightTime);
+
+            if (!unipolar) {
+                if (CVout >= 0.f) {
+                    lights[CV1GREENLED_LIGHT + i * 2].setBrightnessSmooth(clamp(CVout / 10.f, 0.f, 1.f), lightTime);
+                    lights[CV1REDLED_LIGHT + i * 2].setBrightnessSmooth(0.f, lightTime);
+                } else {
+                    lights[CV1GREENLED_LIGHT + i * 2].setBrightnessSmooth(0.f, lightTime);
+                    lights[CV1REDLED_LIGHT + i * 2].setBrightnessSmooth(clamp(-CVout / 10.f, 0.f, 1.f), lightTime);
+                }
+            } else {
+                lights[CV1GREENLED_LIGHT + i * 2].setBrightnessSmooth(clamp(CVout / 5.f, 0.f, 1.f), lightTime);
+                lights[CV1REDLED_LIGHT + i * 2].setBrightnessSmooth(0.f, lightTime);
+            }
+        }
+        gateLightMask = 0;
+
+        lights[DIRECTIONLLED_LIGHT].setBrightnessSmooth(outputs[DIRECTIONL_OUTPUT].getVoltage(0) > 0.f ? 1.f : 0.f, lightTime);
+        lights[DIRECTIONRLED_LIGHT].setBrightnessSmooth(outputs[DIRECTIONR_OUTPUT].getVoltage(0) > 0.f ? 1.f : 0.f, lightTime);
+
+        bool locked = clockSync && clockEdges[0][0] >= 2.f;
+        lights[SYNCLED_LIGHT].setBrightnessSmooth(locked ? 1.f : 0.f, lightTime);
+    }
+
+    /** The latest published profile, with the settings it was measured under. Call from the UI thread only. */
+    json_t* profileToJson() {
+        const PinwheelProfile& profile = profiler.reports.read();
+        json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "module", json_integer(id));
+        json_object_set_new(rootJ, "unit", json_string(PinwheelProfile::unit()));
+        json_object_set_new(rootJ, "sampleRate", json_real(1.f / sampleTime));
+        json_object_set_new(rootJ, "channels", json_integer(channels));
+        json_object_set_new(rootJ, "panels", json_integer(panels));
+        json_object_set_new(rootJ, "blades", json_integer((int) numberOfBlades[0][0]));
+        json_object_set_new(rootJ, "trigMode", json_boolean(trigMode));
+        json_object_set_new(rootJ, "audioRange", json_boolean(audioRange));
+        json_object_set_new(rootJ, "detectors", json_integer(numDetectors));
+        json_object_set_new(rootJ, "controlRateDivision", json_integer(controlRateDivision));
+        json_object_set_new(rootJ, "eventDrivenGates", json_boolean(eventDrivenGates));
+
+        json_object_set_new(rootJ, "samples", json_integer(profile.samples));
+        json_object_set_new(rootJ, "blockSize", json_integer(PinwheelProfiler::blockSize));
+        json_object_set_new(rootJ, "blocks", json_integer(profile.blocks));
+        json_object_set_new(rootJ, "p50", json_integer(profile.p50));
+        json_object_set_new(rootJ, "p99", json_integer(profile.p99));
+        json_object_set_new(rootJ, "max", json_integer(profile.max));
+        json_object_set_new(rootJ, "blockP50", json_integer(profile.blockP50));
+        json_object_set_new(rootJ, "blockP99", json_integer(profile.blockP99));
+        json_object_set_new(rootJ, "blockMax", json_integer(profile.blockMax));
+        json_object_set_new(rootJ, "edges", json_integer(profile.edges));
+        json_object_set_new(rootJ, "slewingSamples", json_integer(profile.slewingSamples));
+
+        // Non-empty buckets only, each with the range of costs it holds
+        json_t* histogramJ = json_array();
+        for (int b = 0; b < PinwheelProfile::buckets; b++) {
+            if (!profile.counts[b])
+                continue;
+            json_t* bucketJ = json_object();
+            json_object_set_new(bucketJ, "from", json_integer(PinwheelProfile::bucketStart(b)));
+            json_object_set_new(bucketJ, "to", json_integer(PinwheelProfile::bucketEnd(b) - 1));
+            json_object_set_new(bucketJ, "count", json_integer(profile.counts[b]));
+            json_array_append_new(histogramJ, bucketJ);
+        }
+        json_object_set_new(rootJ, "histogram", histogramJ);
+        return rootJ;
+    }
+
+    json_t* dataToJson() override {
+        json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "controlRateDivision", json_integer(controlRateDivision));
+        json_object_set_new(rootJ, "eventDrivenGates", json_boolean(eventDrivenGates));
+        json_object_set_new(rootJ, "profiling", json_boolean(profiling));
+        json_object_set_new(rootJ, "physics", json_boolean(physics));
+        json_object_set_new(rootJ, "scopeView", json_boolean(scopeView));
+        json_object_set_new(rootJ, "shape", json_integer(shape));
+        json_object_set_new(rootJ, "detectorOutputs", json_boolean(detectorOutputs));
+
+        json_t* detectorsJ = json_array();
+        for (int d = 0; d < numDetectors; d++) {
+            json_t* detectorJ = json_object();
+            json_object_set_new(detectorJ, "position", json_real(detectors[d].position));
+            json_object_set_new(detectorJ, "halfWidth", json_real(detectors[d].halfWidth));
+            json_array_append_new(detectorsJ, detectorJ);
+        }
+        json_object_set_new(rootJ, "detectors", detectorsJ);
+
+        json_t* bladeShapesJ = json_array();
+        for (int i = 0; i < 8; i++)
+            json_array_append_new(bladeShapesJ, json_integer(bladeShapes[i]));
+        json_object_set_new(rootJ, "bladeShapes", bladeShapesJ);
+
+        json_t* userShapeJ = json_array();
+        for (int k = 0; k < userShapePoints; k++)
+            json_array_append_new(userShapeJ, json_real(userShape[k]));
+        json_object_set_new(rootJ, "userShape", userShapeJ);
+        return rootJ;
+    }
+
+    void dataFromJson(json_t* rootJ) override {
+        json_t* controlRateDivisionJ = json_object_get(rootJ, "controlRateDivision");
+        if (controlRateDivisionJ)
+            controlRateDivision = clamp((int) json_integer_value(controlRateDivisionJ), 1, 256);
+
+        json_t* eventDrivenGatesJ = json_object_get(rootJ, "eventDrivenGates");
+        if (eventDrivenGatesJ)
+            eventDrivenGates = json_boolean_value(eventDrivenGatesJ);
+
+        json_t* profilingJ = json_object_get(rootJ, "profiling");
+        if (profilingJ)
+            profiling = json_boolean_value(profilingJ);
+
+        json_t* physicsJ = json_object_get(rootJ, "physics");
+        if (physicsJ)
+            physics = json_boolean_value(physicsJ);
+
+        json_t* scopeViewJ = json_object_get(rootJ, "scopeView");
+        if (scopeViewJ)
+            scopeView = json_boolean_value(scopeViewJ);
+
+        json_t* shapeJ = json_object_get(rootJ, "shape");
+        if (shapeJ)
+            shape = clamp((int) json_integer_value(shapeJ), 0, SHAPES_LEN - 1);
+
+        json_t* bladeShapesJ = json_object_get(rootJ, "bladeShapes");
+        for (int i = 0; i < 8 && i < (int) json_array_size(bladeShapesJ); i++)
+            bladeShapes[i] = clamp((int) json_integer_value(json_array_get(bladeShapesJ, i)), -1, SHAPES_LEN - 1);
+
+        json_t* userShapeJ = json_object_get(rootJ, "userShape");
+        for (int k = 0; k < userShapePoints && k < (int) json_array_size(userShapeJ); k++)
+            userShape[k] = clamp((float) json_number_value(json_array_get(userShapeJ, k)), -1.f, 1.f);
+        userShapeVersion++;
+
+        json_t* detectorOutputsJ = json_object_get(rootJ, "detectorOutputs");
+        if (detectorOutputsJ)
+            detectorOutputs = json_boolean_value(detectorOutputsJ);
+
+        json_t* detectorsJ = json_object_get(rootJ, "detectors");
+        if (detectorsJ) {
+            numDetectors = clamp((int) json_array_size(detectorsJ), 1, PinwheelDetectorIndex::maxDetectors);
+            for (int d = 0; d < numDetectors; d++) {
+                json_t* detectorJ = json_array_get(detectorsJ, d);
+                detectors[d].position = json_number_value(json_object_get(detectorJ, "position"));
+                detectors[d].halfWidth = clamp((float) json_number_value(json_object_get(detectorJ, "halfWidth")), 0.f, float(M_PI / 2.f));
+            }
+        }
+        detectorVersion++;
+    }
+};
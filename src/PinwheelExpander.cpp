@@ -0,0 +1,256 @@
+#include "Pinwheel.hpp"
+
+// Adds eight blades to a Pinwheel on its left, or to another expander that is already attached to one.
+// The rotor itself only runs in Pinwheel; each expander extrapolates the phase it receives by the one
+// sample of latency the expander message adds, renders its blades and passes the rotor on to the right.
+struct PinwheelExpander : Module {
+	enum ParamId {
+		PARAMS_LEN
+	};
+	enum InputId {
+		INPUTS_LEN
+	};
+	enum OutputId {
+		GATE1OUT_OUTPUT,
+		GATE2OUT_OUTPUT,
+		GATE3OUT_OUTPUT,
+		GATE4OUT_OUTPUT,
+		GATE5OUT_OUTPUT,
+		GATE6OUT_OUTPUT,
+		GATE7OUT_OUTPUT,
+		GATE8OUT_OUTPUT,
+		CV1OUT_OUTPUT,
+		CV2OUT_OUTPUT,
+		CV3OUT_OUTPUT,
+		CV4OUT_OUTPUT,
+		CV5OUT_OUTPUT,
+		CV6OUT_OUTPUT,
+		CV7OUT_OUTPUT,
+		CV8OUT_OUTPUT,
+		OUTPUTS_LEN
+	};
+	enum LightId {
+		ENUMS(GATELED_LIGHT, 8),
+		ENUMS(CVLED_LIGHT, 8 * 2),
+		LINKLED_LIGHT,
+		LIGHTS_LEN
+	};
+
+    PinwheelExpanderMessage messages[2];
+    // Latest detector index to come down the chain, see PinwheelExpanderMessage::detectorIndexSent
+    PinwheelDetectorIndex detectorIndex;
+
+    float_4 prevGateState[8][4] = {};
+    float_4 triggerTimers[8][4] = {};
+    bool linked = false;
+    int gateLightMask = 0;
+
+    dsp::ClockDivider lightDivider;
+
+
+    PinwheelExpander() {
+        config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
+        for (int i = 0; i < 8; i++) {
+            configOutput(GATE1OUT_OUTPUT + i, "Gate Out");
+            configOutput(CV1OUT_OUTPUT + i, "CV Out");
+        }
+        configLight(LINKLED_LIGHT, "Linked to Pinwheel");
+
+        leftExpander.producerMessage = &messages[0];
+        leftExpander.consumerMessage = &messages[1];
+        lightDivider.setDivision(512);
+    }
+
+    void onSampleRateChange(const SampleRateChangeEvent& e) override {
+        lightDivider.setDivision(std::max(1, (int) (e.sampleRate / 60.f)));
+    }
+
+    void process(const ProcessArgs& args) override {
+        PinwheelExpanderMessage* message = (PinwheelExpanderMessage*) leftExpander.consumerMessage;
+
+        // Only a message sent on the previous sample is current; otherwise the chain to Pinwheel is broken
+        Module* left = leftExpander.module;
+        bool leftValid = left && (left->model == modelPinwheel || left->model == modelPinwheelExpander);
+        linked = leftValid && message->frame == args.frame - 1;
+
+        if (!linked) {
+            for (int i = 0; i < OUTPUTS_LEN; ++i) {
+                outputs[i].setVoltage(0.f);
+                outputs[i].setChannels(1);
+            }
+            gateLightMask = 0;
+        } else {
+            if (message->detectorIndexSent) {
+                detectorIndex = message->detectorIndex;
+            }
+            processBlades(message);
+
+            if (message->panel + 1 < Pinwheel::maxPanels && rightExpander.module && rightExpander.module->model == modelPinwheelExpander) {
+                PinwheelExpanderMessage* next = (PinwheelExpanderMessage*) rightExpander.module->leftExpander.producerMessage;
+                forwardMessage(message, next);
+                next->frame = args.frame;
+                next->panel = message->panel + 1;
+                rightExpander.module->leftExpander.requestMessageFlip();
+            }
+        }
+
+        if (lightDivider.process()) {
+            processLights(args.sampleTime * lightDivider.getDivision());
+        }
+    }
+
+    // Copies a message on to the next expander, leaving out the detector index unless it came with this one
+    void forwardMessage(const PinwheelExpanderMessage* message, PinwheelExpanderMessage* next) {
+        next->detectorIndexSent = message->detectorIndexSent;
+        if (message->detectorIndexSent) {
+            next->detectorIndex = message->detectorIndex;
+        }
+        next->frame = message->frame;
+        next->panel = message->panel;
+        next->channels = message->channels;
+        next->trigMode = message->trigMode;
+        next->unipolar = message->unipolar;
+        next->audioRange = message->audioRange;
+        next->detectorOutputs = message->detectorOutputs;
+        std::copy(message->shapeTables, message->shapeTables + 8, next->shapeTables);
+        next->triggerSamples = message->triggerSamples;
+        int groups = (message->channels + 3) / 4;
+        std::copy(message->phase, message->phase + groups, next->phase);
+        std::copy(message->phaseStep, message->phaseStep + groups, next->phaseStep);
+        std::copy(message->phaseStepDelta, message->phaseStepDelta + groups, next->phaseStepDelta);
+        std::copy(message->bladeSpacing, message->bladeSpacing + groups, next->bladeSpacing);
+        std::copy(message->bladeSpacingStep, message->bladeSpacingStep + groups, next->bladeSpacingStep);
+        std::copy(message->angleModStep, message->angleModStep + groups, next->angleModStep);
+        std::copy(message->bladesPerPanel, message->bladesPerPanel + groups, next->bladesPerPanel);
+        std::copy(message->baseSpacing, message->baseSpacing + groups, next->baseSpacing);
+    }
+
+    // Advances the received rotor by the sample it spent in transit, in place so it can be passed on as is
+    void processBlades(PinwheelExpanderMessage* message) {
+        int channels = message->channels;
+
+        for (int i = 0; i < 8; ++i) {
+            outputs[GATE1OUT_OUTPUT + i].setChannels(channels);
+            outputs[CV1OUT_OUTPUT + i].setChannels(channels);
+        }
+
+        for (int c = 0; c < channels; c += 4) {
+            int g = c / 4;
+
+            message->phaseStep[g] += message->phaseStepDelta[g];
+            message->bladeSpacing[g] += message->bladeSpacingStep[g];
+            message->phase[g] += Pinwheel::angleToPhase(message->phaseStep[g]);
+
+            float_4 blades = message->bladesPerPanel[g];
+            float_4 firstBlade = blades * (float) message->panel;
+
+            int32_4 detectorsCovered = 0;
+
+            // Phase of this panel's first blade. Rack's int32_4 has no multiply (it needs SSE4.1), so the
+            // offset is worked out per lane, wrapping the same way repeated additions of the spacing do.
+            int32_t firstOffset[4];
+            for (int k = 0; k < 4; k++) {
+                firstOffset[k] = (int32_t) ((uint32_t) message->bladeSpacing[g][k] * (uint32_t) firstBlade[k]);
+            }
+            int32_4 bladePhase = message->phase[g] + int32_4::load(firstOffset);
+            for (int i = 0; i < 8; ++i, bladePhase += message->bladeSpacing[g]) {
+                float_4 bladeActive = (float) i < blades;
+                float_4 bladeIndex = firstBlade + (float) i;
+
+                const PinwheelWavetable* table = message->shapeTables[i];
+                float_4 CVout = table ? Pinwheel::shapeCV(*table, bladePhase, message->unipolar) : Pinwheel::bladeCV(bladePhase, message->unipolar);
+                float_4 bladeStep = message->phaseStep[g] + message->baseSpacing[g] * bladeIndex * message->angleModStep[g];
+                if (message->audioRange && !table) {
+                    CVout += Pinwheel::bandlimitCV(bladePhase, bladeStep, message->unipolar);
+                }
+                outputs[CV1OUT_OUTPUT + i].setVoltageSimd(simd::ifelse(bladeActive, CVout, 0.f), c);
+
+                const PinwheelDetectorIndex& index = detectorIndex;
+                int32_4 segment, covering, segmentStart, segmentEnd;
+                index.find(bladePhase, segment, covering, segmentStart, segmentEnd);
+
+                if (message->detectorOutputs) {
+                    detectorsCovered |= covering & int32_4::cast(bladeActive);
+                    continue;
+                }
+
+                float_4 sinceStart = Pinwheel::phaseDistance(bladePhase - segmentStart);
+                float_4 untilEnd = Pinwheel::phaseDistance(segmentEnd - bladePhase);
+                float_4 pastEdge = simd::ifelse(bladeStep < 0.f, untilEnd, sinceStart);
+                float_4 gateOut = processGate(i, g, float_4::cast(covering > 0), bladeActive, pastEdge, bladeStep, message);
+
+                float_4 gateVoltage = simd::ifelse(gateOut, 5.f, 0.f);
+                if (message->audioRange && !message->trigMode) {
+                    gateVoltage = simd::ifelse(bladeActive, gateVoltage + Pinwheel::bandlimitGate(index, segment, sinceStart, untilEnd, bladeStep), 0.f);
+                }
+                outputs[GATE1OUT_OUTPUT + i].setVoltageSimd(gateVoltage, c);
+            }
+
+            // Per detector, each gate output reports this panel's blades only
+            if (message->detectorOutputs) {
+                for (int j = 0; j < 8; ++j) {
+                    float_4 gateActive = float_4::cast((detectorsCovered & (1 << j)) > 0);
+                    float_4 gateOut = processGate(j, g, gateActive, float_4::mask(), 0.f, message->phaseStep[g], message);
+                    outputs[GATE1OUT_OUTPUT + j].setVoltageSimd(simd::ifelse(gateOut, 5.f, 0.f), c);
+                }
+            }
+        }
+    }
+
+    float_4 processGate(int i, int g, float_4 gateActive, float_4 bladeActive, float_4 pastEdge, float_4 bladeStep,
+            const PinwheelExpanderMessage* message) {
+        float_4 gateOut = gateActive;
+        if (message->trigMode) {
+            gateOut = Pinwheel::processTrigger(gateActive, bladeActive, pastEdge, bladeStep, message->triggerSamples,
+                prevGateState[i][g], triggerTimers[i][g]);
+        }
+        gateOut = gateOut & bladeActive;
+
+        if (g == 0) {
+            gateLightMask |= (simd::movemask(gateOut) & 1) << i;
+        }
+        return gateOut;
+    }
+
+    // Same light behaviour as Pinwheel, following the first channel
+    void processLights(float lightTime) {
+        bool unipolar = linked && ((PinwheelExpanderMessage*) leftExpander.consumerMessage)->unipolar;
+        for (int i = 0; i < 8; ++i) {
+            float CVout = outputs[CV1OUT_OUTPUT + i].getVoltage(0);
+            bool gate = (gateLightMask & (1 << i)) || outputs[GATE1OUT_OUTPUT + i].getVoltage(0) > 0.f;
+            lights[GATELED_LIGHT + i].setBrightnessSmooth(gate ? 1.f : 0.f, lightTime);
+
+            float scale = unipolar ? 5.f : 10.f;
+            lights[CVLED_LIGHT + i * 2 + 0].setBrightnessSmooth(clamp(CVout / scale, 0.f, 1.f), lightTime);
+            lights[CVLED_LIGHT + i * 2 + 1].setBrightnessSmooth(clamp(-CVout / scale, 0.f, 1.f), lightTime);
+        }
+        gateLightMask = 0;
+
+        lights[LINKLED_LIGHT].setBrightnessSmooth(linked ? 1.f : 0.f, lightTime);
+    }
+};
+
+
+struct PinwheelExpanderWidget : ModuleWidget {
+	PinwheelExpanderWidget(PinwheelExpander* module) {
+		setModule(module);
+		setPanel(createPanel(asset::plugin(pluginInstance, "res/PinwheelExpander.svg")));
+
+		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+		addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+
+		for (int i = 0; i < 8; ++i) {
+			float y = 22.f + 12.5f * i;
+			addChild(createLightCentered<MediumLight<RedLight>>(mm2px(Vec(6.5, y)), module, PinwheelExpander::GATELED_LIGHT + i));
+			addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(14.5, y)), module, PinwheelExpander::GATE1OUT_OUTPUT + i));
+			addChild(createLightCentered<MediumLight<GreenRedLight>>(mm2px(Vec(28.0, y)), module, PinwheelExpander::CVLED_LIGHT + i * 2));
+			addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(36.5, y)), module, PinwheelExpander::CV1OUT_OUTPUT + i));
+		}
+
+		addChild(createLightCentered<MediumLight<GreenLight>>(mm2px(Vec(25.4, 12.0)), module, PinwheelExpander::LINKLED_LIGHT));
+	}
+};
+
+Model* modelPinwheelExpander = createModel<PinwheelExpander, PinwheelExpanderWidget>("PinwheelExpander");
@@ -0,0 +1,226 @@
+#pragma once
+#include "plugin.hpp"
+#include <thread>
+
+/** Streams frames of Pinwheel's outputs to a WAV or raw float file in the background.
+The engine thread only copies each frame into a single-producer single-consumer ring, allocated before recording
+starts; a worker thread drains it to disk with buffered writes. The engine never allocates, locks or touches the
+filesystem. If the disk stalls long enough to fill the ring, frames are dropped and counted rather than waited for. */
+struct PinwheelRecorder {
+    static const int channels = 18;
+    // About 2.7 s at 48 kHz
+    static const int64_t ringFrames = 1 << 17;
+    static const int wavHeaderBytes = 80;
+    // WAV files, header included, are cut below 2 GB, where some readers give up, and recording carries on in a
+    // numbered file. This caps the data chunk, which fileBytes counts.
+    static const int64_t maxWavBytes = ((int64_t) 1 << 31) - wavHeaderBytes;
+
+    enum Format {
+        WAV_FORMAT,
+        RAW_FORMAT,
+    };
+
+    // Set by the UI thread to start or stop; the engine follows it at the next control tick
+    std::atomic<bool> requested{false};
+    // Set by the engine while it pushes frames, and cleared after its last one
+    std::atomic<bool> running{false};
+    // The engine's own copy of running
+    bool recording = false;
+    // Frames pushed by the engine and frames written out by the worker, counted since start()
+    std::atomic<int64_t> written{0};
+    std::atomic<int64_t> read{0};
+    std::atomic<int64_t> dropped{0};
+    std::vector<float> ring;
+
+    // Worker state, only touched by the UI thread while no worker runs
+    std::thread worker;
+    std::atomic<bool> workerDone{true};
+    std::atomic<bool> quit{false};
+    std::atomic<bool> failed{false};
+    std::string path;
+    Format format = WAV_FORMAT;
+    int sampleRate = 44100;
+    FILE* file = NULL;
+    int64_t fileBytes = 0;
+    int fileIndex = 0;
+
+    ~PinwheelRecorder() {
+        // The engine has stopped calling process() by now, so the worker can finish without it
+        quit.store(true, std::memory_order_release);
+        requested.store(false, std::memory_order_release);
+        if (worker.joinable())
+            worker.join();
+    }
+
+    /** UI thread. Opens the file and starts the worker; the engine joins in at its next control tick.
+    Returns false if the file can't be opened or the previous recording is still being written out. */
+    bool start(const std::string& path, Format format, float sampleRate) {
+        if (busy())
+            return false;
+        if (worker.joinable())
+            worker.join();
+
+        this->path = path;
+        this->format = format;
+        this->sampleRate = (int) std::round(sampleRate);
+        fileIndex = 0;
+        failed.store(false, std::memory_order_relaxed);
+        if (!openFile())
+            return false;
+
+        if (ring.empty())
+            ring.resize(ringFrames * channels);
+        written.store(0, std::memory_order_relaxed);
+        read.store(0, std::memory_order_relaxed);
+        dropped.store(0, std::memory_order_relaxed);
+
+        // Requested before the worker starts, so it can't take the engine not having started yet for a stop
+        workerDone.store(false, std::memory_order_relaxed);
+        requested.store(true, std::memory_order_release);
+        worker = std::thread([this]() { run(); });
+        return true;
+    }
+
+    /** UI thread. The worker writes out whatever the engine queued before it noticed, then closes the file. */
+    void stop() {
+        requested.store(false, std::memory_order_release);
+    }
+
+    /** True from start() until the worker has closed the last file. */
+    bool busy() const {
+        return !workerDone.load(std::memory_order_acquire);
+    }
+
+    /** Engine thread, at control rate: follows start() and stop(). */
+    void update() {
+        bool want = requested.load(std::memory_order_acquire);
+        if (want != recording) {
+            recording = want;
+            running.store(want, std::memory_order_release);
+        }
+    }
+
+    /** Engine thread: queues one frame, or drops it if the worker has fallen a whole ring behind. */
+    void push(const float* frame) {
+        int64_t w = written.load(std::memory_order_relaxed);
+        if (w - read.load(std::memory_order_acquire) >= ringFrames) {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        std::copy(frame, frame + channels, &ring[(w & (ringFrames - 1)) * channels]);
+        written.store(w + 1, std::memory_order_release);
+    }
+
+    void run() {
+        while (true) {
+            // Check before draining, so that a stop seen here comes after the engine's last frame
+            bool stopped = !running.load(std::memory_order_acquire) && !requested.load(std::memory_order_acquire);
+            bool quitting = quit.load(std::memory_order_acquire);
+            drain();
+            if (stopped || quitting)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        closeFile();
+        workerDone.store(true, std::memory_order_release);
+    }
+
+    void drain() {
+        const int64_t frameBytes = channels * sizeof(float);
+        int64_t w = written.load(std::memory_order_acquire);
+        int64_t r = read.load(std::memory_order_relaxed);
+        while (r < w) {
+            // Up to the end of the ring, or of the current WAV file
+            int64_t frames = std::min(w - r, ringFrames - (r & (ringFrames - 1)));
+            if (format == WAV_FORMAT) {
+                if (fileBytes + frameBytes > maxWavBytes) {
+                    closeFile();
+                    openFile();
+                }
+                frames = std::min(frames, (maxWavBytes - fileBytes) / frameBytes);
+            }
+            if (file && std::fwrite(&ring[(r & (ringFrames - 1)) * channels], frameBytes, frames, file) != (size_t) frames) {
+                failed.store(true, std::memory_order_relaxed);
+                closeFile();
+            }
+            fileBytes += frames * frameBytes;
+            r += frames;
+            read.store(r, std::memory_order_release);
+        }
+    }
+
+    /** Path of the current file: the chosen one, then "name-2.wav", "name-3.wav" and so on. */
+    std::string filePath() const {
+        if (fileIndex == 0)
+            return path;
+        size_t dot = path.find_last_of('.');
+        size_t slash = path.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = path.size();
+        return path.substr(0, dot) + "-" + std::to_string(fileIndex + 1) + path.substr(dot);
+    }
+
+    bool openFile() {
+        file = std::fopen(filePath().c_str(), "wb");
+        fileBytes = 0;
+        if (!file) {
+            failed.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        std::setvbuf(file, NULL, _IOFBF, 1 << 20);
+        if (format == WAV_FORMAT)
+            writeWavHeader(0);
+        return true;
+    }
+
+    void closeFile() {
+        if (!file)
+            return;
+        if (format == WAV_FORMAT) {
+            std::fseek(file, 0, SEEK_SET);
+            writeWavHeader(fileBytes);
+        }
+        std::fclose(file);
+        file = NULL;
+        fileIndex++;
+    }
+
+    /** 32-bit float WAVE_FORMAT_EXTENSIBLE header, as more than 2 channels call for. */
+    void writeWavHeader(int64_t dataBytes) {
+        uint8_t header[wavHeaderBytes];
+        uint8_t* p = header;
+        auto put = [&](uint32_t value, int bytes) {
+            for (int k = 0; k < bytes; k++)
+                *p++ = (value >> (8 * k)) & 0xff;
+        };
+        auto tag = [&](const char* id) {
+            std::memcpy(p, id, 4);
+            p += 4;
+        };
+        tag("RIFF");
+        put(wavHeaderBytes - 8 + dataBytes, 4);
+        tag("WAVE");
+        tag("fmt ");
+        put(40, 4);
+        // WAVE_FORMAT_EXTENSIBLE, channels, rate, byte rate, block align, bits
+        put(0xfffe, 2);
+        put(channels, 2);
+        put(sampleRate, 4);
+        put(sampleRate * channels * 4, 4);
+        put(channels * 4, 2);
+        put(32, 2);
+        // Extension size, valid bits, no speaker positions, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+        put(22, 2);
+        put(32, 2);
+        put(0, 4);
+        static const uint8_t floatSubtype[16] = {0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71};
+        std::memcpy(p, floatSubtype, 16);
+        p += 16;
+        tag("fact");
+        put(4, 4);
+        put(dataBytes / (channels * 4), 4);
+        tag("data");
+        put(dataBytes, 4);
+        std::fwrite(header, 1, p - header, file);
+    }
+};
@@ -9,6 +9,7 @@ extern Plugin* pluginInstance;
 
 // Declare each Model, defined in each module source file
 extern Model* modelPinwheel;
+extern Model* modelPinwheelExpander;
 
 struct CKSSHorizontal : app::SvgSwitch {
 	CKSSHorizontal() {
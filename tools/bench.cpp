@@ -0,0 +1,207 @@
+// Headless benchmark for Pinwheel::process().
+// Drives the engine for a fixed number of samples across a matrix of settings and reports the
+// cost per sample, optionally as JSON so results can be compared between plugin versions.
+#include <chrono>
+#include <cstdlib>
+// Pinwheel.hpp defines PINWHEEL_HAVE_CYCLES where the time-stamp counter is available
+#include "Pinwheel.hpp"
+
+#ifndef PINWHEEL_VERSION
+#define PINWHEEL_VERSION "unknown"
+#endif
+
+// The tools run Pinwheel on its own, so no expander is ever attached
+Model* modelPinwheelExpander = NULL;
+
+
+struct BenchConfig {
+	int blades;
+	bool trig;
+	bool unipolar;
+	bool cv;
+	float sampleRate;
+};
+
+struct BenchResult {
+	BenchConfig config;
+	double nsPerSample;
+	double cyclesPerSample;
+	float checksum;
+};
+
+static uint64_t readCycles() {
+#ifdef PINWHEEL_HAVE_CYCLES
+	// Time-stamp counter, which ticks at the nominal clock rate rather than the current core clock
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static BenchResult runBench(const BenchConfig& config, long samples, int channels, int controlRateDivision, bool eventDrivenGates) {
+	Pinwheel module;
+	module.controlRateDivision = controlRateDivision;
+	module.eventDrivenGates = eventDrivenGates;
+	module.params[Pinwheel::NUMBLADES_PARAM].setValue(config.blades);
+	module.params[Pinwheel::SPEED_PARAM].setValue(0.8f);
+	module.params[Pinwheel::MASS_PARAM].setValue(0.2f);
+	module.params[Pinwheel::BLADEANGLEMOD_PARAM].setValue(0.25f);
+	module.params[Pinwheel::RANGE_PARAM].setValue(1.f);
+	module.params[Pinwheel::GATE_TRIG_PARAM].setValue(config.trig ? 1.f : 0.f);
+	module.params[Pinwheel::BIPOLAR_UNIPOLAR_PARAM].setValue(config.unipolar ? 1.f : 0.f);
+
+	// Patch every output, and the CV inputs if requested
+	for (Output& output : module.outputs)
+		output.channels = 1;
+	if (config.cv) {
+		module.inputs[Pinwheel::SPEEDCVIN_INPUT].channels = channels;
+		module.inputs[Pinwheel::MASSCVIN_INPUT].channels = channels;
+		module.inputs[Pinwheel::NUMBLADESCVIN_INPUT].channels = channels;
+		module.inputs[Pinwheel::BLADEANGLEMODCVIN_INPUT].channels = channels;
+	}
+
+	Module::SampleRateChangeEvent e;
+	e.sampleRate = config.sampleRate;
+	e.sampleTime = 1.f / config.sampleRate;
+	module.onSampleRateChange(e);
+
+	// Slow LFOs for the CV inputs, tabulated so the benchmark doesn't time its own sin() calls
+	static const int lfoLength = 4096;
+	static float lfo[lfoLength];
+	for (int i = 0; i < lfoLength; i++)
+		lfo[i] = std::sin(2.f * M_PI * i / lfoLength);
+
+	Module::ProcessArgs args;
+	args.sampleRate = config.sampleRate;
+	args.sampleTime = 1.f / config.sampleRate;
+	args.frame = 0;
+
+	auto step = [&]() {
+		if (config.cv) {
+			float v = lfo[(args.frame >> 6) & (lfoLength - 1)];
+			for (int c = 0; c < channels; c++) {
+				module.inputs[Pinwheel::SPEEDCVIN_INPUT].setVoltage(2.f * v, c);
+				module.inputs[Pinwheel::MASSCVIN_INPUT].setVoltage(-v, c);
+				module.inputs[Pinwheel::BLADEANGLEMODCVIN_INPUT].setVoltage(1.5f * v, c);
+			}
+		}
+		module.process(args);
+		args.frame++;
+	};
+
+	// Warm up caches, slews and the branch predictor before timing
+	for (long i = 0; i < samples / 10; i++)
+		step();
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t startCycles = readCycles();
+	for (long i = 0; i < samples; i++)
+		step();
+	uint64_t endCycles = readCycles();
+	auto end = std::chrono::steady_clock::now();
+
+	BenchResult result;
+	result.config = config;
+	result.nsPerSample = std::chrono::duration<double, std::nano>(end - start).count() / samples;
+	result.cyclesPerSample = double(endCycles - startCycles) / samples;
+	result.checksum = 0.f;
+	for (Output& output : module.outputs)
+		result.checksum += output.getVoltage(0);
+	return result;
+}
+
+static void writeJson(FILE* f, const std::vector<BenchResult>& results, long samples, int channels, int controlRateDivision, bool eventDrivenGates) {
+	double totalNs = 0.0;
+	double maxNs = 0.0;
+	for (const BenchResult& r : results) {
+		totalNs += r.nsPerSample;
+		maxNs = std::max(maxNs, r.nsPerSample);
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"plugin\": \"Pinwheel\",\n");
+	fprintf(f, "  \"version\": \"%s\",\n", PINWHEEL_VERSION);
+	fprintf(f, "  \"samples\": %ld,\n", samples);
+	fprintf(f, "  \"channels\": %d,\n", channels);
+	fprintf(f, "  \"controlRateDivision\": %d,\n", controlRateDivision);
+	fprintf(f, "  \"eventDrivenGates\": %s,\n", eventDrivenGates ? "true" : "false");
+	fprintf(f, "  \"meanNsPerSample\": %.3f,\n", totalNs / results.size());
+	fprintf(f, "  \"maxNsPerSample\": %.3f,\n", maxNs);
+	fprintf(f, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		fprintf(f, "    {\"blades\": %d, \"mode\": \"%s\", \"polarity\": \"%s\", \"cv\": %s, \"sampleRate\": %g, \"nsPerSample\": %.3f, ",
+			r.config.blades, r.config.trig ? "trig" : "gate", r.config.unipolar ? "unipolar" : "bipolar",
+			r.config.cv ? "true" : "false", r.config.sampleRate, r.nsPerSample);
+#ifdef PINWHEEL_HAVE_CYCLES
+		fprintf(f, "\"cyclesPerSample\": %.2f}", r.cyclesPerSample);
+#else
+		fprintf(f, "\"cyclesPerSample\": null}");
+#endif
+		fprintf(f, "%s\n", (i + 1 < results.size()) ? "," : "");
+	}
+	fprintf(f, "  ]\n");
+	fprintf(f, "}\n");
+}
+
+static void usage(const char* argv0) {
+	fprintf(stderr, "Usage: %s [--samples N] [--channels N] [--control-rate N] [--no-event-gates] [--json FILE]\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+	long samples = 2000000;
+	int channels = 1;
+	int controlRateDivision = 16;
+	bool eventDrivenGates = true;
+	const char* jsonPath = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--samples" && i + 1 < argc)
+			samples = std::max(1L, std::atol(argv[++i]));
+		else if (arg == "--channels" && i + 1 < argc)
+			channels = clamp(std::atoi(argv[++i]), 1, 16);
+		else if (arg == "--control-rate" && i + 1 < argc)
+			controlRateDivision = clamp(std::atoi(argv[++i]), 1, 256);
+		else if (arg == "--no-event-gates")
+			eventDrivenGates = false;
+		else if (arg == "--json" && i + 1 < argc)
+			jsonPath = argv[++i];
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	const float sampleRates[] = {44100.f, 96000.f, 192000.f};
+
+	std::vector<BenchResult> results;
+	printf("%-6s %-5s %-8s %-3s %-7s %10s %12s\n", "blades", "mode", "polarity", "cv", "rate", "ns/sample", "cycles/sample");
+	for (float sampleRate : sampleRates) {
+		for (int cv = 0; cv < 2; cv++) {
+			for (int trig = 0; trig < 2; trig++) {
+				for (int unipolar = 0; unipolar < 2; unipolar++) {
+					for (int blades = 1; blades <= 8; blades++) {
+						BenchConfig config = {blades, (bool) trig, (bool) unipolar, (bool) cv, sampleRate};
+						BenchResult r = runBench(config, samples, channels, controlRateDivision, eventDrivenGates);
+						results.push_back(r);
+						printf("%-6d %-5s %-8s %-3s %-7g %10.2f %12.1f\n", blades, trig ? "trig" : "gate",
+							unipolar ? "unipolar" : "bipolar", cv ? "yes" : "no", sampleRate, r.nsPerSample, r.cyclesPerSample);
+					}
+				}
+			}
+		}
+	}
+
+	if (jsonPath) {
+		FILE* f = std::fopen(jsonPath, "w");
+		if (!f) {
+			fprintf(stderr, "Could not write %s\n", jsonPath);
+			return 1;
+		}
+		writeJson(f, results, samples, channels, controlRateDivision, eventDrivenGates);
+		std::fclose(f);
+		printf("Wrote %s\n", jsonPath);
+	}
+	return 0;
+}
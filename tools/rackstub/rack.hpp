@@ -0,0 +1,481 @@
+#pragma once
+// Minimal stand-in for the parts of the Rack SDK that the Pinwheel engine uses, so that
+// Pinwheel::process() can be built and driven headless by the tools in this directory.
+// Only engine-side types are provided; nothing here draws or touches the filesystem.
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <pmmintrin.h>
+#include <smmintrin.h>
+
+// jansson, enough for Module::dataToJson()/dataFromJson() round trips
+struct json_t {
+	enum Type { OBJECT, ARRAY, INTEGER, REAL, TRUE, FALSE, STRING } type;
+	long long i = 0;
+	double r = 0.0;
+	std::string s;
+	std::map<std::string, std::shared_ptr<json_t>> object;
+	std::vector<std::shared_ptr<json_t>> array;
+	explicit json_t(Type type) : type(type) {}
+};
+inline json_t* json_object() { return new json_t(json_t::OBJECT); }
+inline json_t* json_array() { return new json_t(json_t::ARRAY); }
+inline json_t* json_integer(long long i) { json_t* j = new json_t(json_t::INTEGER); j->i = i; return j; }
+inline json_t* json_real(double r) { json_t* j = new json_t(json_t::REAL); j->r = r; return j; }
+inline json_t* json_boolean(bool b) { return new json_t(b ? json_t::TRUE : json_t::FALSE); }
+inline json_t* json_string(const char* s) { json_t* j = new json_t(json_t::STRING); j->s = s; return j; }
+inline json_t* json_object_get(const json_t* o, const char* key) {
+	if (!o || o->type != json_t::OBJECT) return NULL;
+	auto it = o->object.find(key);
+	return it == o->object.end() ? NULL : it->second.get();
+}
+inline int json_object_set_new(json_t* o, const char* key, json_t* value) { o->object[key].reset(value); return 0; }
+inline int json_array_append_new(json_t* a, json_t* value) { a->array.emplace_back(value); return 0; }
+inline size_t json_array_size(const json_t* a) { return (a && a->type == json_t::ARRAY) ? a->array.size() : 0; }
+inline json_t* json_array_get(const json_t* a, size_t index) { return index < json_array_size(a) ? a->array[index].get() : NULL; }
+inline long long json_integer_value(const json_t* j) { return (j && j->type == json_t::INTEGER) ? j->i : 0; }
+inline double json_real_value(const json_t* j) { return (j && j->type == json_t::REAL) ? j->r : 0.0; }
+inline double json_number_value(const json_t* j) { return !j ? 0.0 : j->type == json_t::INTEGER ? j->i : j->type == json_t::REAL ? j->r : 0.0; }
+inline bool json_is_true(const json_t* j) { return j && j->type == json_t::TRUE; }
+inline bool json_boolean_value(const json_t* j) { return json_is_true(j); }
+inline const char* json_string_value(const json_t* j) { return (j && j->type == json_t::STRING) ? j->s.c_str() : NULL; }
+inline void json_decref(json_t* j) { delete j; }
+#define json_array_foreach(array, index, value) \
+	for (index = 0; index < json_array_size(array) && (value = json_array_get(array, index)); index++)
+
+/** Declares an enum range of `count` ids starting at `name`, as in Rack's common.hpp */
+#define ENUMS(name, count) name, name ## _LAST = name + (count) - 1
+
+namespace rack {
+
+namespace math {
+inline int clamp(int x, int a, int b) { return std::max(std::min(x, b), a); }
+inline float clamp(float x, float a = 0.f, float b = 1.f) { return std::fmax(std::fmin(x, b), a); }
+inline float rescale(float x, float xMin, float xMax, float yMin, float yMax) {
+	return yMin + (x - xMin) / (xMax - xMin) * (yMax - yMin);
+}
+inline float crossfade(float a, float b, float p) { return a + (b - a) * p; }
+inline bool isNear(float a, float b, float epsilon = 1e-6f) { return std::fabs(a - b) <= epsilon; }
+inline float eucMod(float a, float b) { float m = std::fmod(a, b); if (m < 0.f) m += b; return m; }
+inline int eucMod(int a, int b) { int m = a % b; if (m < 0) m += b; return m; }
+struct Vec {
+	float x = 0.f, y = 0.f;
+	Vec() {}
+	Vec(float x, float y) : x(x), y(y) {}
+	Vec plus(Vec b) const { return Vec(x + b.x, y + b.y); }
+	Vec minus(Vec b) const { return Vec(x - b.x, y - b.y); }
+	Vec mult(float s) const { return Vec(x * s, y * s); }
+	Vec div(float s) const { return Vec(x / s, y / s); }
+};
+struct Rect {
+	Vec pos, size;
+	Rect() {}
+	Rect(Vec pos, Vec size) : pos(pos), size(size) {}
+	Rect(float x, float y, float w, float h) : pos(x, y), size(w, h) {}
+};
+}
+using namespace math;
+
+namespace simd {
+template <typename T, int N> struct Vector;
+
+template <>
+struct Vector<float, 4> {
+	using type = float;
+	constexpr static int size = 4;
+	union {
+		__m128 v;
+		float s[4];
+	};
+	Vector() = default;
+	Vector(__m128 v) : v(v) {}
+	Vector(float x) { v = _mm_set1_ps(x); }
+	Vector(float x1, float x2, float x3, float x4) { v = _mm_setr_ps(x1, x2, x3, x4); }
+	static Vector zero() { return Vector(_mm_setzero_ps()); }
+	static Vector mask() { return Vector(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_setzero_si128(), _mm_setzero_si128()))); }
+	static Vector load(const float* x) { return Vector(_mm_loadu_ps(x)); }
+	void store(float* z) { _mm_storeu_ps(z, v); }
+	float& operator[](int i) { return s[i]; }
+	const float& operator[](int i) const { return s[i]; }
+	Vector(Vector<int32_t, 4> a);
+	static Vector cast(Vector<int32_t, 4> a);
+};
+
+template <>
+struct Vector<int32_t, 4> {
+	using type = int32_t;
+	constexpr static int size = 4;
+	union {
+		__m128i v;
+		int32_t s[4];
+	};
+	Vector() = default;
+	Vector(__m128i v) : v(v) {}
+	Vector(int32_t x) { v = _mm_set1_epi32(x); }
+	Vector(int32_t x1, int32_t x2, int32_t x3, int32_t x4) { v = _mm_setr_epi32(x1, x2, x3, x4); }
+	static Vector zero() { return Vector(_mm_setzero_si128()); }
+	static Vector mask() { return Vector(_mm_cmpeq_epi32(_mm_setzero_si128(), _mm_setzero_si128())); }
+	static Vector load(const int32_t* x) { return Vector(_mm_loadu_si128((const __m128i*) x)); }
+	void store(int32_t* z) { _mm_storeu_si128((__m128i*) z, v); }
+	int32_t& operator[](int i) { return s[i]; }
+	const int32_t& operator[](int i) const { return s[i]; }
+	Vector(Vector<float, 4> a);
+	static Vector cast(Vector<float, 4> a);
+};
+
+inline Vector<float, 4>::Vector(Vector<int32_t, 4> a) { v = _mm_cvtepi32_ps(a.v); }
+inline Vector<int32_t, 4>::Vector(Vector<float, 4> a) { v = _mm_cvttps_epi32(a.v); }
+inline Vector<float, 4> Vector<float, 4>::cast(Vector<int32_t, 4> a) { return Vector(_mm_castsi128_ps(a.v)); }
+inline Vector<int32_t, 4> Vector<int32_t, 4>::cast(Vector<float, 4> a) { return Vector(_mm_castps_si128(a.v)); }
+
+typedef Vector<float, 4> float_4;
+typedef Vector<int32_t, 4> int32_4;
+
+#define STUB_OP(op, T, fn) \
+	inline Vector<T, 4> op(const Vector<T, 4>& a, const Vector<T, 4>& b) { return Vector<T, 4>(fn(a.v, b.v)); } \
+	inline Vector<T, 4> op(const Vector<T, 4>& a, const T& b) { return op(a, Vector<T, 4>(b)); } \
+	inline Vector<T, 4> op(const T& a, const Vector<T, 4>& b) { return op(Vector<T, 4>(a), b); }
+#define STUB_OPEQ(op, opeq, T) \
+	inline Vector<T, 4>& opeq(Vector<T, 4>& a, const Vector<T, 4>& b) { return a = op(a, b); } \
+	inline Vector<T, 4>& opeq(Vector<T, 4>& a, const T& b) { return a = op(a, b); }
+
+STUB_OP(operator+, float, _mm_add_ps)
+STUB_OP(operator-, float, _mm_sub_ps)
+STUB_OP(operator*, float, _mm_mul_ps)
+STUB_OP(operator/, float, _mm_div_ps)
+STUB_OP(operator&, float, _mm_and_ps)
+STUB_OP(operator|, float, _mm_or_ps)
+STUB_OP(operator^, float, _mm_xor_ps)
+STUB_OP(operator==, float, _mm_cmpeq_ps)
+STUB_OP(operator!=, float, _mm_cmpneq_ps)
+STUB_OP(operator<, float, _mm_cmplt_ps)
+STUB_OP(operator<=, float, _mm_cmple_ps)
+STUB_OP(operator>, float, _mm_cmpgt_ps)
+STUB_OP(operator>=, float, _mm_cmpge_ps)
+STUB_OPEQ(operator+, operator+=, float)
+STUB_OPEQ(operator-, operator-=, float)
+STUB_OPEQ(operator*, operator*=, float)
+STUB_OPEQ(operator/, operator/=, float)
+STUB_OPEQ(operator&, operator&=, float)
+STUB_OPEQ(operator|, operator|=, float)
+STUB_OPEQ(operator^, operator^=, float)
+STUB_OP(operator+, int32_t, _mm_add_epi32)
+STUB_OP(operator-, int32_t, _mm_sub_epi32)
+STUB_OP(operator&, int32_t, _mm_and_si128)
+STUB_OP(operator|, int32_t, _mm_or_si128)
+STUB_OP(operator^, int32_t, _mm_xor_si128)
+STUB_OP(operator==, int32_t, _mm_cmpeq_epi32)
+STUB_OP(operator<, int32_t, _mm_cmplt_epi32)
+STUB_OP(operator>, int32_t, _mm_cmpgt_epi32)
+STUB_OPEQ(operator+, operator+=, int32_t)
+STUB_OPEQ(operator-, operator-=, int32_t)
+STUB_OPEQ(operator&, operator&=, int32_t)
+STUB_OPEQ(operator|, operator|=, int32_t)
+#undef STUB_OP
+#undef STUB_OPEQ
+
+inline float_4 operator-(const float_4& a) { return 0.f - a; }
+inline float_4 operator~(const float_4& a) { return a ^ float_4::mask(); }
+inline int32_4 operator~(const int32_4& a) { return a ^ int32_4::mask(); }
+inline int32_4 operator<<(const int32_4& a, const int& b) { return int32_4(_mm_sll_epi32(a.v, _mm_cvtsi32_si128(b))); }
+inline int32_4 operator>>(const int32_4& a, const int& b) { return int32_4(_mm_srl_epi32(a.v, _mm_cvtsi32_si128(b))); }
+
+inline float_4 ifelse(float_4 mask, float_4 a, float_4 b) { return (mask & a) | float_4(_mm_andnot_ps(mask.v, b.v)); }
+inline int32_4 ifelse(int32_4 mask, int32_4 a, int32_4 b) { return (mask & a) | int32_4(_mm_andnot_si128(mask.v, b.v)); }
+inline int movemask(float_4 a) { return _mm_movemask_ps(a.v); }
+inline int movemask(int32_4 a) { return _mm_movemask_ps(_mm_castsi128_ps(a.v)); }
+inline float_4 fmin(float_4 a, float_4 b) { return float_4(_mm_min_ps(a.v, b.v)); }
+inline float_4 fmax(float_4 a, float_4 b) { return float_4(_mm_max_ps(a.v, b.v)); }
+inline float_4 clamp(float_4 x, float_4 a = 0.f, float_4 b = 1.f) { return fmin(fmax(x, a), b); }
+inline float_4 fabs(float_4 a) { return a & float_4(_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))); }
+inline float_4 floor(float_4 a) { return float_4(_mm_floor_ps(a.v)); }
+inline float_4 ceil(float_4 a) { return float_4(_mm_ceil_ps(a.v)); }
+inline float_4 round(float_4 a) { return float_4(_mm_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+inline float_4 trunc(float_4 a) { return float_4(_mm_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)); }
+inline float_4 sqrt(float_4 a) { return float_4(_mm_sqrt_ps(a.v)); }
+inline float_4 fmod(float_4 a, float_4 b) { return a - floor(a / b) * b; }
+inline float_4 sgn(float_4 x) { float_4 signbit = x & -0.f; float_4 nonzero = (x != 0.f); return signbit | (nonzero & 1.f); }
+inline float_4 crossfade(float_4 a, float_4 b, float_4 p) { return a + (b - a) * p; }
+#define STUB_LANEWISE(name, fn) \
+	inline float_4 name(float_4 a) { return float_4(fn(a[0]), fn(a[1]), fn(a[2]), fn(a[3])); }
+STUB_LANEWISE(sin, std::sin)
+STUB_LANEWISE(cos, std::cos)
+STUB_LANEWISE(exp, std::exp)
+STUB_LANEWISE(log, std::log)
+#undef STUB_LANEWISE
+inline float_4 pow(float_4 a, float_4 b) { return float_4(std::pow(a[0], b[0]), std::pow(a[1], b[1]), std::pow(a[2], b[2]), std::pow(a[3], b[3])); }
+inline float_4 pow(float a, float_4 b) { return pow(float_4(a), b); }
+using std::fmin;
+using std::fmax;
+using std::fabs;
+using std::floor;
+using std::round;
+using std::sin;
+using std::cos;
+inline float ifelse(bool c, float a, float b) { return c ? a : b; }
+inline int movemask(bool c) { return c; }
+}
+
+namespace dsp {
+static const float FREQ_C4 = 261.6256f;
+
+template <typename T>
+T exp2_taylor5(T x) {
+	using namespace simd;
+	T xi = floor(x);
+	T xf = x - xi;
+	T yi = pow(2.f, xi);
+	T yf = 1.f + xf * (0.6931471805599453f + xf * (0.2402265069591007f + xf * (0.05550410866482158f + xf * (0.009618129107628477f + xf * 0.0013333558146428443f))));
+	return yi * yf;
+}
+
+struct ClockDivider {
+	uint32_t clock = 0;
+	uint32_t division = 1;
+	void reset() { clock = 0; }
+	void setDivision(uint32_t division) { this->division = division; }
+	uint32_t getDivision() { return division; }
+	uint32_t getClock() { return clock; }
+	bool process() {
+		clock++;
+		if (clock >= division) {
+			clock = 0;
+			return true;
+		}
+		return false;
+	}
+};
+
+template <typename T = float>
+struct TSchmittTrigger {
+	T state = T::mask();
+	void reset() { state = T::mask(); }
+	T process(T in, T offThreshold = 0.f, T onThreshold = 1.f) {
+		T on = (in >= onThreshold);
+		T off = (in <= offThreshold);
+		T triggered = ~state & on;
+		state = on | (state & ~off);
+		return triggered;
+	}
+};
+
+template <>
+struct TSchmittTrigger<float> {
+	bool state = true;
+	void reset() { state = true; }
+	bool process(float in, float offThreshold = 0.f, float onThreshold = 1.f) {
+		if (state) {
+			if (in <= offThreshold) state = false;
+		}
+		else {
+			if (in >= onThreshold) {
+				state = true;
+				return true;
+			}
+		}
+		return false;
+	}
+	bool isHigh() { return state; }
+};
+typedef TSchmittTrigger<> SchmittTrigger;
+
+struct PulseGenerator {
+	float remaining = 0.f;
+	void reset() { remaining = 0.f; }
+	bool process(float deltaTime) {
+		if (remaining > 0.f) {
+			remaining -= deltaTime;
+			return true;
+		}
+		return false;
+	}
+	void trigger(float duration = 1e-3f) {
+		if (duration > remaining) remaining = duration;
+	}
+};
+}
+
+namespace plugin {
+struct Model;
+}
+
+namespace engine {
+struct ParamQuantity {
+	float minValue = 0.f, maxValue = 1.f, defaultValue = 0.f;
+	std::string name, unit, description;
+	bool snapEnabled = false;
+	virtual ~ParamQuantity() {}
+};
+struct SwitchQuantity : ParamQuantity {
+	std::vector<std::string> labels;
+};
+struct PortInfo {
+	std::string name, description;
+};
+
+struct Param {
+	float value = 0.f;
+	float getValue() { return value; }
+	void setValue(float value) { this->value = value; }
+};
+
+static const int PORT_MAX_CHANNELS = 16;
+
+struct Port {
+	union {
+		float voltages[PORT_MAX_CHANNELS] = {};
+		float value;
+	};
+	uint8_t channels = 0;
+	float getVoltage(int channel = 0) { return voltages[channel]; }
+	void setVoltage(float voltage, int channel = 0) { voltages[channel] = voltage; }
+	float getPolyVoltage(int channel) { return isMonophonic() ? getVoltage(0) : getVoltage(channel); }
+	template <typename T>
+	T getVoltageSimd(int firstChannel) { return T::load(&voltages[firstChannel]); }
+	template <typename T>
+	T getPolyVoltageSimd(int firstChannel) { return isMonophonic() ? getVoltage(0) : getVoltageSimd<T>(firstChannel); }
+	template <typename T>
+	void setVoltageSimd(T voltage, int firstChannel) { voltage.store(&voltages[firstChannel]); }
+	void setChannels(int channels) {
+		if (this->channels == 0) return;
+		for (int c = channels; c < this->channels; c++) voltages[c] = 0.f;
+		if (channels == 0) channels = 1;
+		this->channels = channels;
+	}
+	int getChannels() { return channels; }
+	bool isConnected() { return channels > 0; }
+	bool isMonophonic() { return channels == 1; }
+	bool isPolyphonic() { return channels > 1; }
+};
+struct Output : Port {};
+struct Input : Port {};
+
+struct Light {
+	float value = 0.f;
+	void setBrightness(float brightness) { value = brightness; }
+	float getBrightness() { return value; }
+	void setBrightnessSmooth(float brightness, float deltaTime, float lambda = 30.f) {
+		if (brightness < value) value += (brightness - value) * lambda * deltaTime;
+		else value = brightness;
+	}
+};
+
+struct Module {
+	struct Expander {
+		int64_t moduleId = -1;
+		Module* module = NULL;
+		void* producerMessage = NULL;
+		void* consumerMessage = NULL;
+		bool messageFlipRequested = false;
+		void requestMessageFlip() { messageFlipRequested = true; }
+	};
+
+	plugin::Model* model = NULL;
+	int64_t id = -1;
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+	std::vector<ParamQuantity*> paramQuantities;
+	Expander leftExpander;
+	Expander rightExpander;
+
+	struct ProcessArgs {
+		float sampleRate;
+		float sampleTime;
+		int64_t frame;
+	};
+	struct SampleRateChangeEvent {
+		float sampleRate;
+		float sampleTime;
+	};
+	struct ResetEvent {};
+	struct RandomizeEvent {};
+	struct AddEvent {};
+	struct RemoveEvent {};
+
+	virtual ~Module() {
+		for (ParamQuantity* pq : paramQuantities) delete pq;
+	}
+	void config(int numParams, int numInputs, int numOutputs, int numLights = 0) {
+		params.resize(numParams);
+		inputs.resize(numInputs);
+		outputs.resize(numOutputs);
+		lights.resize(numLights);
+		paramQuantities.resize(numParams, NULL);
+	}
+	template <class TParamQuantity = ParamQuantity>
+	TParamQuantity* configParam(int paramId, float minValue, float maxValue, float defaultValue, std::string name = "", std::string unit = "", float displayBase = 0.f, float displayMultiplier = 1.f, float displayOffset = 0.f) {
+		delete paramQuantities[paramId];
+		TParamQuantity* q = new TParamQuantity;
+		q->minValue = minValue;
+		q->maxValue = maxValue;
+		q->defaultValue = defaultValue;
+		q->name = name;
+		q->unit = unit;
+		paramQuantities[paramId] = q;
+		params[paramId].value = defaultValue;
+		return q;
+	}
+	template <class TSwitchQuantity = SwitchQuantity>
+	TSwitchQuantity* configSwitch(int paramId, float minValue, float maxValue, float defaultValue, std::string name = "", std::vector<std::string> labels = {}) {
+		TSwitchQuantity* sq = configParam<TSwitchQuantity>(paramId, minValue, maxValue, defaultValue, name);
+		sq->snapEnabled = true;
+		sq->labels = labels;
+		return sq;
+	}
+	template <class TSwitchQuantity = SwitchQuantity>
+	TSwitchQuantity* configButton(int paramId, std::string name = "") {
+		return configSwitch<TSwitchQuantity>(paramId, 0.f, 1.f, 0.f, name, {});
+	}
+	PortInfo* configInput(int portId, std::string name = "") { return NULL; }
+	PortInfo* configOutput(int portId, std::string name = "") { return NULL; }
+	void* configLight(int lightId, std::string name = "") { return NULL; }
+	void configBypass(int inputId, int outputId) {}
+
+	virtual void process(const ProcessArgs& args) {}
+	virtual void onSampleRateChange(const SampleRateChangeEvent& e) {}
+	virtual void onReset(const ResetEvent& e) {}
+	virtual void onRandomize(const RandomizeEvent& e) {}
+	virtual void onAdd(const AddEvent& e) {}
+	virtual void onRemove(const RemoveEvent& e) {}
+	virtual json_t* dataToJson() { return NULL; }
+	virtual void dataFromJson(json_t* rootJ) {}
+};
+}
+using namespace engine;
+
+struct Svg {
+	static std::shared_ptr<Svg> load(const std::string& filename) { return NULL; }
+};
+
+namespace asset {
+inline std::string system(std::string filename = "") { return filename; }
+}
+
+namespace plugin {
+struct Model {};
+}
+using plugin::Model;
+
+struct Plugin {};
+
+namespace app {
+struct SvgSwitch {
+	struct Shadow {
+		float opacity = 1.f;
+	};
+	Shadow shadowStorage;
+	Shadow* shadow = &shadowStorage;
+	void addFrame(std::shared_ptr<Svg> svg) {}
+};
+}
+
+}
@@ -0,0 +1,708 @@
+// Offline renderer for Pinwheel output traces.
+// Runs the engine from a scripted automation file as fast as possible and records every output,
+// so optimized builds can be checked sample by sample against a stored golden trace.
+//
+// Script format, one statement per line, '#' starts a comment:
+//   rate 48000                  engine sample rate in Hz
+//   duration 10                 length of the render in seconds
+//   channels 4                  polyphony of patched CV inputs
+//   option controlRate 16       module options: controlRate, eventGates (--option overrides them)
+//   <time> <target> <value> [<ramp seconds>]
+// Targets are the params speed, mass, blades, anglemod, range, mode, polarity, ratio, friction (raw param
+// values), the inputs speed_cv, mass_cv, blades_cv, anglemod_cv, voct, wind, gust (volts, or "off" to
+// unpatch), and clock, which drives the clock input with a 0-10V square wave at the value in Hz.
+// Context menu settings are targets too: shape (CV shape index, as in the menu), shape1 to shape8 (per
+// blade, -1 for the CV shape), detectors (count), detector1_position to detector8_position and
+// detector1_width to detector8_width (degrees, as in the menu sliders), detector_outputs (0 per blade,
+// 1 per detector) and physics (0 or 1, the physical rotor).
+// With a ramp time, the value moves linearly from its current value starting at <time>.
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include "Pinwheel.hpp"
+
+// The tools run Pinwheel on its own, so no expander is ever attached
+Model* modelPinwheelExpander = NULL;
+
+
+static const char traceMagic[4] = {'P', 'W', 'T', 'R'};
+static const uint32_t traceVersion = 1;
+
+/** What a trace records, as stored in its header. */
+struct TraceInfo {
+	float sampleRate = 0.f;
+	std::vector<std::string> names;
+	uint64_t frames = 0;
+};
+
+struct AutomationEvent {
+	double time;
+	std::string target;
+	float value;
+	double ramp;
+	bool disconnect;
+};
+
+struct Script {
+	float sampleRate = 48000.f;
+	double duration = 10.0;
+	int channels = 1;
+	int controlRateDivision = 16;
+	bool eventDrivenGates = true;
+	std::vector<AutomationEvent> events;
+};
+
+/** Where an automation target lives in the module. */
+struct Target {
+	enum Kind {
+		PARAM,
+		INPUT,
+		// The clock input, driven with a square wave at the value in Hz
+		CLOCK,
+		// CV shape of every blade, or of blade id with -1 for the CV shape
+		SHAPE,
+		BLADE_SHAPE,
+		// Number of detectors, position or width of detector id, and what the gate outputs follow
+		DETECTORS,
+		DETECTOR_POSITION,
+		DETECTOR_WIDTH,
+		DETECTOR_OUTPUTS,
+		PHYSICS,
+	};
+	Kind kind;
+	int id;
+
+	bool isInput() const {
+		return kind == INPUT || kind == CLOCK;
+	}
+
+	bool operator==(const Target& other) const {
+		return kind == other.kind && id == other.id;
+	}
+};
+
+static std::map<std::string, Target> scriptTargets() {
+	std::map<std::string, Target> targets = {
+		{"speed", {Target::PARAM, Pinwheel::SPEED_PARAM}},
+		{"mass", {Target::PARAM, Pinwheel::MASS_PARAM}},
+		{"blades", {Target::PARAM, Pinwheel::NUMBLADES_PARAM}},
+		{"anglemod", {Target::PARAM, Pinwheel::BLADEANGLEMOD_PARAM}},
+		{"range", {Target::PARAM, Pinwheel::RANGE_PARAM}},
+		{"mode", {Target::PARAM, Pinwheel::GATE_TRIG_PARAM}},
+		{"polarity", {Target::PARAM, Pinwheel::BIPOLAR_UNIPOLAR_PARAM}},
+		{"ratio", {Target::PARAM, Pinwheel::RATIO_PARAM}},
+		{"friction", {Target::PARAM, Pinwheel::FRICTION_PARAM}},
+		{"speed_cv", {Target::INPUT, Pinwheel::SPEEDCVIN_INPUT}},
+		{"mass_cv", {Target::INPUT, Pinwheel::MASSCVIN_INPUT}},
+		{"blades_cv", {Target::INPUT, Pinwheel::NUMBLADESCVIN_INPUT}},
+		{"anglemod_cv", {Target::INPUT, Pinwheel::BLADEANGLEMODCVIN_INPUT}},
+		{"voct", {Target::INPUT, Pinwheel::VOCT_INPUT}},
+		{"wind", {Target::INPUT, Pinwheel::WIND_INPUT}},
+		{"gust", {Target::INPUT, Pinwheel::GUST_INPUT}},
+		{"clock", {Target::CLOCK, Pinwheel::CLOCK_INPUT}},
+		{"shape", {Target::SHAPE, 0}},
+		{"detectors", {Target::DETECTORS, 0}},
+		{"detector_outputs", {Target::DETECTOR_OUTPUTS, 0}},
+		{"physics", {Target::PHYSICS, 0}},
+	};
+	for (int i = 0; i < 8; i++)
+		targets["shape" + std::to_string(i + 1)] = {Target::BLADE_SHAPE, i};
+	for (int d = 0; d < PinwheelDetectorIndex::maxDetectors; d++) {
+		targets["detector" + std::to_string(d + 1) + "_position"] = {Target::DETECTOR_POSITION, d};
+		targets["detector" + std::to_string(d + 1) + "_width"] = {Target::DETECTOR_WIDTH, d};
+	}
+	return targets;
+}
+
+static bool findTarget(const std::string& name, Target* target) {
+	static const std::map<std::string, Target> targets = scriptTargets();
+	auto it = targets.find(name);
+	if (it == targets.end())
+		return false;
+	*target = it->second;
+	return true;
+}
+
+/** Sets a module option, from an option statement or the command line. */
+static bool setOption(Script* script, const std::string& name, int value) {
+	if (name == "controlRate")
+		script->controlRateDivision = clamp(value, 1, 256);
+	else if (name == "eventGates")
+		script->eventDrivenGates = value;
+	else
+		return false;
+	return true;
+}
+
+static bool parseScript(const std::string& path, Script* script) {
+	std::ifstream file(path);
+	if (!file) {
+		fprintf(stderr, "Could not open script %s\n", path.c_str());
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream ss(line);
+		std::string first;
+		if (!(ss >> first))
+			continue;
+
+		bool ok = true;
+		if (first == "rate") {
+			ok = bool(ss >> script->sampleRate) && script->sampleRate > 0.f;
+		}
+		else if (first == "duration") {
+			ok = bool(ss >> script->duration) && script->duration > 0.0;
+		}
+		else if (first == "channels") {
+			ok = bool(ss >> script->channels);
+			script->channels = clamp(script->channels, 1, 16);
+		}
+		else if (first == "option") {
+			std::string name;
+			int value;
+			ok = bool(ss >> name >> value) && setOption(script, name, value);
+		}
+		else {
+			AutomationEvent event;
+			std::string value;
+			event.time = std::atof(first.c_str());
+			event.ramp = 0.0;
+			ok = bool(ss >> event.target >> value);
+			ss >> event.ramp;
+			event.disconnect = (value == "off");
+			event.value = event.disconnect ? 0.f : std::atof(value.c_str());
+			Target target;
+			ok = ok && findTarget(event.target, &target);
+			if (ok)
+				script->events.push_back(event);
+		}
+
+		if (!ok) {
+			fprintf(stderr, "%s:%d: could not parse \"%s\"\n", path.c_str(), lineNumber, line.c_str());
+			return false;
+		}
+	}
+
+	std::stable_sort(script->events.begin(), script->events.end(), [](const AutomationEvent& a, const AutomationEvent& b) {
+		return a.time < b.time;
+	});
+	return true;
+}
+
+static const char* const outputNames[] = {
+	"Gate1", "Gate2", "Gate3", "Gate4", "Gate5", "Gate6", "Gate7", "Gate8",
+	"CV1", "CV2", "CV3", "CV4", "CV5", "CV6", "CV7", "CV8",
+	"DirL", "DirR",
+	"AllCV", "AllGates",
+};
+static_assert(sizeof(outputNames) / sizeof(outputNames[0]) == Pinwheel::OUTPUTS_LEN, "Every output needs a trace name");
+
+/** Channels render() records from output o. The bundles carry one channel per blade of the first rotor,
+or per detector, rather than one per rotor, so all 8 are recorded whatever their current width. */
+static int traceChannels(const Script& script, int o) {
+	return (o == Pinwheel::ALLCV_OUTPUT || o == Pinwheel::ALLGATES_OUTPUT) ? 8 : script.channels;
+}
+
+/** The signals render() records for the script: every output channel, in output order. */
+static TraceInfo traceInfo(const Script& script) {
+	TraceInfo info;
+	info.sampleRate = script.sampleRate;
+	for (int o = 0; o < Pinwheel::OUTPUTS_LEN; o++) {
+		for (int c = 0; c < traceChannels(script, o); c++) {
+			std::string name = outputNames[o];
+			// Bundle channels follow the gate and CV outputs they copy, rotor channels are numbered
+			if (o == Pinwheel::ALLCV_OUTPUT)
+				name += ".CV" + std::to_string(c + 1);
+			else if (o == Pinwheel::ALLGATES_OUTPUT)
+				name += ".Gate" + std::to_string(c + 1);
+			else if (script.channels > 1)
+				name += "." + std::to_string(c + 1);
+			info.names.push_back(name);
+		}
+	}
+	info.frames = (uint64_t) std::ceil(script.duration * script.sampleRate);
+	return info;
+}
+
+/** Runs the script and hands every frame of the signals in traceInfo() to onFrame as it is rendered. */
+static void render(const Script& script, const std::function<void(const float*)>& onFrame) {
+	Pinwheel module;
+	module.controlRateDivision = script.controlRateDivision;
+	module.eventDrivenGates = script.eventDrivenGates;
+	for (Output& output : module.outputs)
+		output.channels = 1;
+
+	Module::SampleRateChangeEvent e;
+	e.sampleRate = script.sampleRate;
+	e.sampleTime = 1.f / script.sampleRate;
+	module.onSampleRateChange(e);
+
+	long frames = (long) traceInfo(script).frames;
+	std::vector<float> values;
+	values.reserve(traceInfo(script).names.size());
+
+	// Ramps that are still running: target, start value, end value, start frame, end frame
+	struct Ramp {
+		Target target;
+		float from;
+		float to;
+		long start;
+		long end;
+	};
+	std::vector<Ramp> ramps;
+
+	// Square wave on the clock input while it is patched
+	float clockFrequency = 0.f;
+	double clockPhase = 0.0;
+
+	auto getValue = [&](const Target& target) {
+		switch (target.kind) {
+			case Target::PARAM: return module.params[target.id].getValue();
+			case Target::INPUT: return module.inputs[target.id].getVoltage(0);
+			case Target::CLOCK: return clockFrequency;
+			case Target::SHAPE: return (float) module.shape;
+			case Target::BLADE_SHAPE: return (float) module.bladeShapes[target.id];
+			case Target::DETECTORS: return (float) module.numDetectors;
+			case Target::DETECTOR_POSITION: return eucMod((module.detectors[target.id].position - 1.5f * M_PI) * float(180.f / M_PI), 360.f);
+			case Target::DETECTOR_WIDTH: return module.detectors[target.id].halfWidth * float(360.f / M_PI);
+			case Target::DETECTOR_OUTPUTS: return (float) module.detectorOutputs;
+			case Target::PHYSICS: return (float) module.physics;
+		}
+		return 0.f;
+	};
+	auto setValue = [&](const Target& target, float value) {
+		switch (target.kind) {
+			case Target::PARAM:
+				module.params[target.id].setValue(value);
+				break;
+			case Target::INPUT:
+				for (int c = 0; c < script.channels; c++)
+					module.inputs[target.id].setVoltage(value, c);
+				break;
+			case Target::CLOCK:
+				clockFrequency = value;
+				break;
+			case Target::SHAPE:
+				module.shape = clamp((int) std::round(value), 0, Pinwheel::SHAPES_LEN - 1);
+				break;
+			case Target::BLADE_SHAPE:
+				module.bladeShapes[target.id] = clamp((int) std::round(value), -1, Pinwheel::SHAPES_LEN - 1);
+				break;
+			// Detector changes bump the version, as the context menu does, so the engine rebuilds its index
+			case Target::DETECTORS:
+				module.numDetectors = clamp((int) std::round(value), 1, PinwheelDetectorIndex::maxDetectors);
+				module.detectorVersion++;
+				break;
+			case Target::DETECTOR_POSITION:
+				module.detectors[target.id].position = 1.5f * M_PI + value * float(M_PI / 180.f);
+				module.detectorVersion++;
+				break;
+			case Target::DETECTOR_WIDTH:
+				module.detectors[target.id].halfWidth = clamp(value, 0.f, 180.f) * float(M_PI / 360.f);
+				module.detectorVersion++;
+				break;
+			case Target::DETECTOR_OUTPUTS:
+				module.detectorOutputs = value >= 0.5f;
+				break;
+			case Target::PHYSICS:
+				module.physics = value >= 0.5f;
+				break;
+		}
+	};
+
+	Module::ProcessArgs args;
+	args.sampleRate = script.sampleRate;
+	args.sampleTime = 1.f / script.sampleRate;
+
+	size_t nextEvent = 0;
+	for (long frame = 0; frame < frames; frame++) {
+		while (nextEvent < script.events.size() && script.events[nextEvent].time * script.sampleRate <= frame) {
+			const AutomationEvent& event = script.events[nextEvent++];
+			Target target;
+			findTarget(event.target, &target);
+			// Drop any ramp this event overrides
+			ramps.erase(std::remove_if(ramps.begin(), ramps.end(), [&](const Ramp& r) {
+				return r.target == target;
+			}), ramps.end());
+
+			if (target.isInput()) {
+				if (event.disconnect) {
+					module.inputs[target.id].channels = 0;
+					for (int c = 0; c < script.channels; c++)
+						module.inputs[target.id].setVoltage(0.f, c);
+					if (target.kind == Target::CLOCK)
+						clockFrequency = 0.f;
+					continue;
+				}
+				module.inputs[target.id].channels = script.channels;
+			}
+			if (event.ramp > 0.0) {
+				long rampFrames = std::max(1L, (long) std::round(event.ramp * script.sampleRate));
+				ramps.push_back({target, getValue(target), event.value, frame, frame + rampFrames});
+			}
+			else {
+				setValue(target, event.value);
+			}
+		}
+
+		for (size_t i = 0; i < ramps.size();) {
+			const Ramp& r = ramps[i];
+			float p = float(frame - r.start) / (r.end - r.start);
+			setValue(r.target, crossfade(r.from, r.to, std::min(p, 1.f)));
+			if (frame >= r.end)
+				ramps.erase(ramps.begin() + i);
+			else
+				i++;
+		}
+
+		if (module.inputs[Pinwheel::CLOCK_INPUT].channels > 0) {
+			for (int c = 0; c < script.channels; c++)
+				module.inputs[Pinwheel::CLOCK_INPUT].setVoltage(clockPhase < 0.5 ? 10.f : 0.f, c);
+			clockPhase += clockFrequency / script.sampleRate;
+			clockPhase -= std::floor(clockPhase);
+		}
+
+		args.frame = frame;
+		module.process(args);
+
+		values.clear();
+		for (int o = 0; o < Pinwheel::OUTPUTS_LEN; o++) {
+			// Channels past the output's current width are recorded as 0 V, as a cable would carry them
+			for (int c = 0; c < traceChannels(script, o); c++)
+				values.push_back(c < module.outputs[o].getChannels() ? module.outputs[o].getVoltage(c) : 0.f);
+		}
+		onFrame(values.data());
+	}
+}
+
+/** Writes a trace one frame at a time, as CSV if the path ends in .csv and in the binary format otherwise. */
+struct TraceWriter {
+	FILE* f = NULL;
+	bool csv = false;
+	size_t signals = 0;
+	uint64_t frames = 0;
+	std::vector<uint8_t> mask;
+	std::vector<float> changed;
+	std::vector<float> previous;
+
+	bool open(const std::string& path, const TraceInfo& info) {
+		f = std::fopen(path.c_str(), "wb");
+		if (!f) {
+			fprintf(stderr, "Could not write %s\n", path.c_str());
+			return false;
+		}
+		csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+		signals = info.names.size();
+		frames = 0;
+
+		if (csv) {
+			fprintf(f, "frame");
+			for (const std::string& name : info.names)
+				fprintf(f, ",%s", name.c_str());
+			fprintf(f, "\n");
+			return true;
+		}
+
+		// Magic, version, sample rate, signal count, frame count, names, then one record per frame:
+		// a bitmask of the signals that changed since the previous frame followed by their float32 values.
+		// Gates and the direction outputs rarely change, so traces end up well under half their raw size.
+		// The frame count is written again by close(), once it is known for certain.
+		uint32_t signalCount = signals;
+		std::fwrite(traceMagic, 1, 4, f);
+		std::fwrite(&traceVersion, sizeof(traceVersion), 1, f);
+		std::fwrite(&info.sampleRate, sizeof(info.sampleRate), 1, f);
+		std::fwrite(&signalCount, sizeof(signalCount), 1, f);
+		std::fwrite(&info.frames, sizeof(info.frames), 1, f);
+		for (const std::string& name : info.names)
+			std::fwrite(name.c_str(), 1, name.size() + 1, f);
+		mask.assign((signals + 7) / 8, 0);
+		previous.assign(signals, 0.f);
+		return true;
+	}
+
+	void write(const float* values) {
+		if (csv) {
+			fprintf(f, "%llu", (unsigned long long) frames);
+			for (size_t s = 0; s < signals; s++)
+				fprintf(f, ",%.9g", values[s]);
+			fprintf(f, "\n");
+		}
+		else {
+			std::fill(mask.begin(), mask.end(), 0);
+			changed.clear();
+			for (size_t s = 0; s < signals; s++) {
+				// Compare bit patterns so -0 and NaN payloads survive the round trip
+				if (std::memcmp(&values[s], &previous[s], sizeof(float)) != 0) {
+					mask[s / 8] |= 1 << (s % 8);
+					changed.push_back(values[s]);
+					previous[s] = values[s];
+				}
+			}
+			std::fwrite(mask.data(), 1, mask.size(), f);
+			std::fwrite(changed.data(), sizeof(float), changed.size(), f);
+		}
+		frames++;
+	}
+
+	bool close() {
+		if (!csv) {
+			// After the magic, version, sample rate and signal count
+			std::fseek(f, 16, SEEK_SET);
+			std::fwrite(&frames, sizeof(frames), 1, f);
+		}
+		bool ok = !std::ferror(f);
+		ok = std::fclose(f) == 0 && ok;
+		f = NULL;
+		return ok;
+	}
+};
+
+/** Reads a binary trace one frame at a time. */
+struct TraceReader {
+	FILE* f = NULL;
+	std::string path;
+	TraceInfo info;
+	uint64_t frame = 0;
+	// Set if the file ended before its header said it would
+	bool failed = false;
+	std::vector<uint8_t> mask;
+	std::vector<float> previous;
+
+	~TraceReader() {
+		if (f)
+			std::fclose(f);
+	}
+
+	bool open(const std::string& path) {
+		this->path = path;
+		f = std::fopen(path.c_str(), "rb");
+		if (!f) {
+			fprintf(stderr, "Could not open trace %s\n", path.c_str());
+			return false;
+		}
+
+		char magic[4];
+		uint32_t version = 0;
+		uint32_t signals = 0;
+		bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, traceMagic, 4) == 0;
+		ok = ok && std::fread(&version, sizeof(version), 1, f) == 1 && version == traceVersion;
+		ok = ok && std::fread(&info.sampleRate, sizeof(info.sampleRate), 1, f) == 1;
+		ok = ok && std::fread(&signals, sizeof(signals), 1, f) == 1;
+		ok = ok && std::fread(&info.frames, sizeof(info.frames), 1, f) == 1;
+
+		for (uint32_t s = 0; ok && s < signals; s++) {
+			std::string name;
+			int ch;
+			while ((ch = std::fgetc(f)) > 0)
+				name += (char) ch;
+			ok = (ch == 0);
+			info.names.push_back(name);
+		}
+		mask.assign((signals + 7) / 8, 0);
+		previous.assign(signals, 0.f);
+
+		if (!ok)
+			fprintf(stderr, "%s is not a Pinwheel trace (use the binary format for compare)\n", path.c_str());
+		return ok;
+	}
+
+	/** Decodes the next frame into values. Returns false at the end of the trace or if it is cut short. */
+	bool read(float* values) {
+		if (frame >= info.frames)
+			return false;
+		bool ok = std::fread(mask.data(), 1, mask.size(), f) == mask.size();
+		for (size_t s = 0; ok && s < previous.size(); s++) {
+			if (mask[s / 8] & (1 << (s % 8)))
+				ok = std::fread(&previous[s], sizeof(float), 1, f) == 1;
+			values[s] = previous[s];
+		}
+		if (!ok) {
+			fprintf(stderr, "%s is cut short at frame %llu\n", path.c_str(), (unsigned long long) frame);
+			failed = true;
+			return false;
+		}
+		frame++;
+		return true;
+	}
+};
+
+/** Compares two traces frame by frame, keeping only the first divergence and the largest error. */
+struct TraceComparison {
+	const TraceInfo* golden = NULL;
+	float tolerance = 0.f;
+	bool matching = true;
+	bool diverged = false;
+	double maxError = 0.0;
+	uint64_t maxFrame = 0;
+	size_t maxSignal = 0;
+	uint64_t frames = 0;
+
+	/** Returns false if the traces don't record the same signals at the same rate, and can't be compared. */
+	bool begin(const TraceInfo& golden, const TraceInfo& candidate, float tolerance) {
+		this->golden = &golden;
+		this->tolerance = tolerance;
+		matching = golden.names == candidate.names && golden.sampleRate == candidate.sampleRate;
+		if (!matching)
+			printf("Traces have different signals or sample rates\n");
+		return matching;
+	}
+
+	void add(const float* goldenValues, const float* candidateValues) {
+		for (size_t s = 0; s < golden->names.size(); s++) {
+			float a = goldenValues[s];
+			float b = candidateValues[s];
+			double error = std::fabs((double) a - (double) b);
+			// NaN in one trace and not the other is always a divergence
+			if (std::isnan(a) != std::isnan(b))
+				error = INFINITY;
+			if (error > tolerance && !diverged) {
+				diverged = true;
+				printf("First divergence at frame %llu (%.6f s), %s: golden %.9g, candidate %.9g\n",
+					(unsigned long long) frames, frames / golden->sampleRate, golden->names[s].c_str(), a, b);
+			}
+			if (error > maxError) {
+				maxError = error;
+				maxFrame = frames;
+				maxSignal = s;
+			}
+		}
+		frames++;
+	}
+
+	/** Reports the result. Returns true if the traces match within tolerance. */
+	bool finish(uint64_t candidateFrames) {
+		if (!matching)
+			return false;
+		if (golden->frames != candidateFrames) {
+			printf("Traces have different lengths: golden %llu frames, candidate %llu frames\n",
+				(unsigned long long) golden->frames, (unsigned long long) candidateFrames);
+			diverged = true;
+		}
+		if (maxError > 0.0)
+			printf("Max error %.9g at frame %llu, %s\n", maxError, (unsigned long long) maxFrame, golden->names[maxSignal].c_str());
+		else
+			printf("Bit-exact over %llu frames, %zu signals\n", (unsigned long long) frames, golden->names.size());
+		return !diverged;
+	}
+};
+
+static void usage(const char* argv0) {
+	fprintf(stderr,
+		"Usage: %s SCRIPT -o TRACE          render SCRIPT to TRACE (.csv for text, anything else binary)\n"
+		"       %s SCRIPT --compare GOLDEN  render SCRIPT and compare it against GOLDEN\n"
+		"       %s --compare GOLDEN TRACE   compare two binary traces\n"
+		"Options: --tolerance VOLTS (default 0, bit-exact)\n"
+		"         --option NAME VALUE (overrides the script's option NAME)\n",
+		argv0, argv0, argv0);
+}
+
+int main(int argc, char* argv[]) {
+	std::string scriptPath;
+	std::string outputPath;
+	std::vector<std::string> comparePaths;
+	float tolerance = 0.f;
+	std::vector<std::pair<std::string, int>> options;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-o" && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (arg == "--compare" && i + 1 < argc)
+			comparePaths.push_back(argv[++i]);
+		else if (arg == "--tolerance" && i + 1 < argc)
+			tolerance = std::atof(argv[++i]);
+		else if (arg == "--option" && i + 2 < argc) {
+			options.push_back(std::make_pair(std::string(argv[i + 1]), std::atoi(argv[i + 2])));
+			i += 2;
+		}
+		else if (!arg.empty() && arg[0] != '-' && scriptPath.empty() && comparePaths.empty())
+			scriptPath = arg;
+		else if (!arg.empty() && arg[0] != '-' && comparePaths.size() == 1)
+			comparePaths.push_back(arg);
+		else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	// Compare two stored traces
+	if (scriptPath.empty()) {
+		if (comparePaths.size() != 2) {
+			usage(argv[0]);
+			return 2;
+		}
+		TraceReader golden, candidate;
+		if (!golden.open(comparePaths[0]) || !candidate.open(comparePaths[1]))
+			return 2;
+		TraceComparison comparison;
+		if (!comparison.begin(golden.info, candidate.info, tolerance))
+			return 1;
+		std::vector<float> a(golden.info.names.size());
+		std::vector<float> b(candidate.info.names.size());
+		while (golden.read(a.data()) && candidate.read(b.data()))
+			comparison.add(a.data(), b.data());
+		if (golden.failed || candidate.failed)
+			return 2;
+		return comparison.finish(candidate.info.frames) ? 0 : 1;
+	}
+
+	if (outputPath.empty() && comparePaths.empty()) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	Script script;
+	if (!parseScript(scriptPath, &script))
+		return 2;
+	for (const auto& option : options) {
+		if (!setOption(&script, option.first, option.second)) {
+			fprintf(stderr, "Unknown option %s\n", option.first.c_str());
+			return 2;
+		}
+	}
+	TraceInfo info = traceInfo(script);
+
+	// Frames go straight to the output file and the comparison as they are rendered, so neither trace is
+	// ever held in memory and renders of any length run in constant space
+	TraceWriter writer;
+	if (!outputPath.empty() && !writer.open(outputPath, info))
+		return 2;
+
+	TraceReader golden;
+	TraceComparison comparison;
+	bool comparing = !comparePaths.empty();
+	if (comparing) {
+		if (!golden.open(comparePaths[0]))
+			return 2;
+		comparing = comparison.begin(golden.info, info, tolerance);
+		if (!comparing && outputPath.empty())
+			return 1;
+	}
+
+	std::vector<float> goldenValues(info.names.size());
+	bool goldenLeft = comparing;
+	render(script, [&](const float* values) {
+		if (writer.f)
+			writer.write(values);
+		if (goldenLeft && (goldenLeft = golden.read(goldenValues.data())))
+			comparison.add(goldenValues.data(), values);
+	});
+
+	if (writer.f && !writer.close()) {
+		fprintf(stderr, "Could not write %s\n", outputPath.c_str());
+		return 2;
+	}
+	if (golden.failed)
+		return 2;
+	if (!comparePaths.empty())
+		return comparison.finish(info.frames) ? 0 : 1;
+	return 0;
+}